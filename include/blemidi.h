@@ -0,0 +1,278 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+#define BLE_MIDI_SERVICE_UUID "03b80e5a-ede8-4b33-a751-6ce34ec4c700"
+#define BLE_MIDI_CHARACTERISTIC_UUID "7772e5db-3868-4112-a1a9-f2669d106bf3"
+#define BLE_MIDI_MAX_PACKET 244 // Largest packet we build (ESP32 maximum MTU 247 - 3 bytes ATT header)
+#define BLE_MIDI_MIN_PACKET 20 // Packet size available with default MTU 23
+#define BLE_MIDI_SYSEX_MAX 32 // Longest incoming SysEx message body (excluding F0 / F7) passed on - longer messages are dropped
+#define BLE_MIDI_RX_LATENCY 20000 // Incoming messages are applied this long after they were sent (us) - must exceed delivery jitter
+#define BLE_MIDI_DRIFT_SHIFT 8 // Clock offset rises by delay / 2^BLE_MIDI_DRIFT_SHIFT per message to follow drift between sender and local clocks
+
+// Quantity of data bytes following a status byte
+inline uint8_t midiDataLength(uint8_t status) {
+    switch (status & 0xF0) {
+        case 0xC0:
+        case 0xD0:
+            return 1;
+        case 0xF0:
+            switch (status) {
+                case 0xF1:
+                case 0xF3:
+                    return 1;
+                case 0xF2:
+                    return 2;
+                default:
+                    return 0;
+            }
+        default:
+            return 2;
+    }
+}
+
+// Callback for each decoded MIDI message. timestamp: Sender's 13-bit ms timestamp
+typedef void (*midi_message_cb_t)(uint8_t status, uint8_t data1, uint8_t data2, uint16_t timestamp);
+
+// Callback for each complete SysEx message. data: Bytes between F0 and F7. timestamp: Sender's 13-bit ms timestamp of F7
+typedef void (*midi_sysex_cb_t)(const uint8_t* data, uint8_t len, uint16_t timestamp);
+
+/*  Builds BLE MIDI packets from channel messages
+    Packet is a header byte holding timestamp bits 12..7 followed by messages, each preceded by a timestamp byte holding bits 6..0.
+    Running status omits repeated status bytes and a repeated timestamp byte is omitted when consecutive messages share it.
+*/
+class BleMidiEncoder {
+    public:
+        // Set maximum packet size (peer MTU - 3) and empty packet
+        void begin(uint16_t maxSize) {
+            m_max = maxSize > BLE_MIDI_MAX_PACKET ? BLE_MIDI_MAX_PACKET : maxSize;
+            if (m_max < BLE_MIDI_MIN_PACKET)
+                m_max = BLE_MIDI_MIN_PACKET;
+            clear();
+        }
+
+        void clear() {
+            m_size = 0;
+            m_messages = 0;
+            m_runningStatus = 0;
+        }
+
+        /*  Add a channel message to packet
+            ms: Time message was generated (ms)
+            Returns false if message does not fit in this packet - send packet, clear and add again
+        */
+        bool add(uint16_t ms, uint8_t status, uint8_t data1, uint8_t data2) {
+            uint8_t len = midiDataLength(status);
+            uint8_t ts = 0x80 | (ms & 0x7F);
+            if (m_size == 0) {
+                m_firstMs = ms;
+                m_buffer[m_size++] = 0x80 | ((ms >> 7) & 0x3F);
+            } else if ((uint16_t)(ms - m_firstMs) > 127) {
+                // Receiver can only detect a single wrap of the timestamp low byte
+                return false;
+            }
+            bool sendTs = (status != m_runningStatus || ts != m_lastTs);
+            bool sendStatus = (status != m_runningStatus);
+            uint16_t needed = len + (sendTs ? 1 : 0) + (sendStatus ? 1 : 0);
+            if (m_size + needed > m_max)
+                return false;
+            if (sendTs)
+                m_buffer[m_size++] = ts;
+            if (sendStatus)
+                m_buffer[m_size++] = status;
+            m_buffer[m_size++] = data1 & 0x7F;
+            if (len > 1)
+                m_buffer[m_size++] = data2 & 0x7F;
+            m_runningStatus = status;
+            m_lastTs = ts;
+            ++m_messages;
+            return true;
+        }
+
+        bool empty() {
+            return m_messages == 0;
+        }
+
+        const uint8_t* data() {
+            return m_buffer;
+        }
+
+        uint16_t size() {
+            return m_size;
+        }
+
+        // Quantity of MIDI messages in packet
+        uint8_t messages() {
+            return m_messages;
+        }
+
+    private:
+        uint8_t m_buffer[BLE_MIDI_MAX_PACKET];
+        uint16_t m_size = 0;
+        uint16_t m_max = BLE_MIDI_MIN_PACKET;
+        uint16_t m_firstMs = 0;
+        uint8_t m_messages = 0;
+        uint8_t m_runningStatus = 0;
+        uint8_t m_lastTs = 0;
+};
+
+/*  Parses BLE MIDI packets into MIDI messages
+    Handles timestamp bytes, running status (with or without timestamp), system real-time messages interleaved anywhere, including within other messages, and system common messages.
+    SysEx may span packets so parsing state is kept between packets. SysEx bodies up to BLE_MIDI_SYSEX_MAX bytes are passed to a separate callback.
+*/
+class BleMidiDecoder {
+    public:
+        void decode(const uint8_t* data, uint16_t len, midi_message_cb_t cb, midi_sysex_cb_t sysexCb=nullptr) {
+            if (len < 2 || !(data[0] & 0x80))
+                return; // Not a BLE MIDI packet
+            uint16_t tsHigh = (data[0] & 0x3F) << 7;
+            uint8_t tsLow = 0;
+            uint16_t ts = tsHigh;
+            bool haveTs = false; // True if last byte was a timestamp so next status byte is a status
+            for (uint16_t i = 1; i < len; ++i) {
+                uint8_t b = data[i];
+                if (b & 0x80) {
+                    if (!haveTs) {
+                        // Timestamp byte - low 7 bits wrap at most once per packet
+                        if ((b & 0x7F) < tsLow)
+                            tsHigh += 0x80;
+                        tsLow = b & 0x7F;
+                        ts = (tsHigh + tsLow) & 0x1FFF;
+                        haveTs = true;
+                        continue;
+                    }
+                    haveTs = false;
+                    if (b >= 0xF8) {
+                        // System real-time does not affect running status
+                        cb(b, 0, 0, ts);
+                        continue;
+                    }
+                    if (b == 0xF7) {
+                        if (m_sysex && m_sysexLen <= BLE_MIDI_SYSEX_MAX && sysexCb)
+                            sysexCb(m_sysexData, m_sysexLen, ts);
+                        m_sysex = false;
+                        m_status = 0;
+                        continue;
+                    }
+                    m_sysex = (b == 0xF0); // Any other status ends SysEx without passing it on
+                    if (m_sysex) {
+                        m_sysexLen = 0;
+                        m_status = 0;
+                        continue;
+                    }
+                    m_status = b;
+                    m_count = 0;
+                    if (midiDataLength(b) == 0) {
+                        cb(b, 0, 0, ts);
+                        m_status = 0;
+                    }
+                } else {
+                    haveTs = false;
+                    if (m_sysex) {
+                        if (m_sysexLen < BLE_MIDI_SYSEX_MAX)
+                            m_sysexData[m_sysexLen] = b;
+                        if (m_sysexLen <= BLE_MIDI_SYSEX_MAX)
+                            ++m_sysexLen; // BLE_MIDI_SYSEX_MAX + 1 marks too long
+                        continue;
+                    }
+                    if (!m_status)
+                        continue;
+                    m_data[m_count++] = b;
+                    if (m_count == midiDataLength(m_status)) {
+                        cb(m_status, m_data[0], m_count > 1 ? m_data[1] : 0, ts);
+                        m_count = 0;
+                        if (m_status >= 0xF0)
+                            m_status = 0; // System common messages do not set running status
+                    }
+                }
+            }
+        }
+
+        // Forget partial message, e.g. on disconnect
+        void reset() {
+            m_status = 0;
+            m_count = 0;
+            m_sysex = false;
+        }
+
+    private:
+        uint8_t m_status = 0; // Running status, 0 if none
+        uint8_t m_data[2];
+        uint8_t m_count = 0; // Quantity of data bytes received for current message
+        bool m_sysex = false; // True whilst within SysEx
+        uint8_t m_sysexData[BLE_MIDI_SYSEX_MAX];
+        uint8_t m_sysexLen = 0; // Quantity of SysEx body bytes received
+};
+
+/*  Maps sender BLE MIDI timestamps to local time
+    The 13-bit ms timestamp is unwrapped to a continuous sender time using the local time elapsed since the previous message.
+    Local receive time minus sender time is transit delay plus an unknown clock offset. The least delayed message sets the offset, which then rises slowly so that drift between the clocks is followed.
+    Delay of each message beyond the least delayed is delivery jitter, e.g. waiting for the next connection interval.
+*/
+class BleMidiTimebase {
+    public:
+        /*  Map a message timestamp to local time
+            timestamp: Sender's 13-bit ms timestamp
+            us: Local time message was received (us)
+            Returns estimated local time message was sent (us)
+        */
+        uint32_t map(uint16_t timestamp, uint32_t us) {
+            if (!m_synced) {
+                m_senderMs = timestamp;
+                m_offset = us - timestamp * 1000;
+                m_lastUs = us;
+                m_delay = 0;
+                m_synced = true;
+                return us;
+            }
+            uint32_t expected = m_senderMs + (us - m_lastUs) / 1000;
+            int16_t diff = (timestamp - expected) & 0x1FFF;
+            if (diff >= 0x1000)
+                diff -= 0x2000; // Nearest unwrapped time - may be slightly before previous message
+            m_senderMs = expected + diff;
+            m_lastUs = us;
+            int32_t delay = us - (m_senderMs * 1000 + m_offset);
+            if (delay < 0) {
+                m_offset += delay;
+                delay = 0;
+            } else {
+                m_offset += delay >> BLE_MIDI_DRIFT_SHIFT;
+            }
+            m_delay = delay;
+            return us - delay;
+        }
+
+        // Forget sender clock, e.g. on disconnect
+        void reset() {
+            m_synced = false;
+        }
+
+        // Delay of last message beyond least delayed message (us)
+        uint32_t delay() const {
+            return m_delay;
+        }
+
+    private:
+        uint32_t m_senderMs = 0; // Unwrapped sender time of last message (ms)
+        uint32_t m_offset = 0; // Local time minus sender time of least delayed message (us)
+        uint32_t m_lastUs = 0; // Local time last message was received (us)
+        uint32_t m_delay = 0;
+        bool m_synced = false;
+};
@@ -0,0 +1,152 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+#define CLOCK_PPQN 24 // MIDI clocks per beat
+#define CLOCK_ACQUIRE_TICKS 24 // Quantity of clocks averaged to estimate initial tempo
+#define CLOCK_PHASE_SHIFT 4 // Phase correction per clock is error / 2^CLOCK_PHASE_SHIFT
+#define CLOCK_PERIOD_SHIFT 10 // Period correction per clock is error / 2^CLOCK_PERIOD_SHIFT
+#define CLOCK_SLIP_TICKS 4 // Error (in clocks) beyond which tracking restarts, e.g. tempo jump
+#define CLOCK_TIMEOUT_US 500000 // Lock is lost if no clock received for this long (us)
+
+/*  Tracks MIDI clock with a second order phase locked loop
+    Each received clock adjusts the predicted clock phase and period by a fraction of the prediction error so that delivery jitter (e.g. BLE connection interval bursts) is filtered out.
+    Times are in us and may wrap. Clock position counts clocks since MIDI Start.
+*/
+class ClockPll {
+    public:
+        // MIDI Start - next clock is first clock of song
+        void start() {
+            m_position = m_phasePosition = -1;
+            m_running = true;
+        }
+
+        // MIDI Continue - resume from current position
+        void resume() {
+            m_running = true;
+        }
+
+        // MIDI Stop
+        void stop() {
+            m_running = false;
+        }
+
+        // MIDI Song Position Pointer (16th notes)
+        void setPosition(uint16_t spp) {
+            m_position = m_phasePosition = spp * (CLOCK_PPQN / 4) - 1;
+        }
+
+        // MIDI Clock received at given time (us)
+        void tick(uint32_t us) {
+            if (m_running)
+                ++m_position;
+            bool lost = m_acquired >= CLOCK_ACQUIRE_TICKS && !locked(us);
+            m_lastUs = us;
+            if (lost) {
+                // Clock resumed after a gap - tempo may have changed
+                m_jitter = 0;
+                tickAcquire(us);
+                return;
+            }
+            if (m_acquired < CLOCK_ACQUIRE_TICKS) {
+                // Average initial clocks to estimate period
+                if (m_acquired == 0)
+                    m_firstUs = us;
+                else
+                    m_period = ((uint64_t)(us - m_firstUs) << 8) / m_acquired;
+                m_phase = us;
+                m_phasePosition = m_position;
+                ++m_acquired;
+                return;
+            }
+            int32_t predictedPeriod = m_period >> 8;
+            uint32_t predicted = m_phase + predictedPeriod;
+            int32_t err = (int32_t)(us - predicted);
+            if (err > CLOCK_SLIP_TICKS * predictedPeriod || err < -CLOCK_SLIP_TICKS * predictedPeriod) {
+                // Lost track - start again from this clock
+                m_jitter = 0;
+                tickAcquire(us);
+                return;
+            }
+            m_period += (int32_t)(((int64_t)err << 8) >> CLOCK_PERIOD_SHIFT);
+            m_phase = predicted + (err >> CLOCK_PHASE_SHIFT);
+            m_phasePosition = m_position;
+            int32_t absErr = err < 0 ? -err : err;
+            m_jitter += (absErr - m_jitter) / 16;
+        }
+
+        // True if tempo has been estimated and a clock was received less than CLOCK_TIMEOUT_US before given time (us)
+        bool locked(uint32_t us) const {
+            return m_acquired >= CLOCK_ACQUIRE_TICKS && (int32_t)(us - m_lastUs) < CLOCK_TIMEOUT_US;
+        }
+
+        // True if between MIDI Start / Continue and Stop
+        bool running() const {
+            return m_running;
+        }
+
+        // Clocks since MIDI Start (-1 before first clock)
+        int32_t position() const {
+            return m_position;
+        }
+
+        // Predicted time (us) of a clock position
+        uint32_t tickTime(int32_t position) const {
+            return m_phase + (int32_t)((int64_t)(position - m_phasePosition) * m_period >> 8);
+        }
+
+        // Estimated clock period (us)
+        uint32_t period() const {
+            return m_period >> 8;
+        }
+
+        // Estimated tempo (BPM x 10)
+        uint16_t bpm() const {
+            return m_period ? 600000000ULL * 256 / ((uint64_t)m_period * CLOCK_PPQN) : 0;
+        }
+
+        // Smoothed absolute difference between received and predicted clock times (us)
+        uint32_t jitter() const {
+            return m_jitter;
+        }
+
+        // Time last clock was received (us)
+        uint32_t lastTick() const {
+            return m_lastUs;
+        }
+
+    private:
+        void tickAcquire(uint32_t us) {
+            m_firstUs = us;
+            m_phase = us;
+            m_phasePosition = m_position;
+            m_acquired = 1;
+        }
+
+        uint32_t m_period = 0; // Clock period (us x 256)
+        uint32_t m_phase = 0; // Predicted time of clock at m_phasePosition (us)
+        int32_t m_phasePosition = -1; // Clock position of m_phase
+        int32_t m_position = -1;
+        uint32_t m_firstUs = 0;
+        uint32_t m_lastUs = 0;
+        int32_t m_jitter = 0;
+        uint16_t m_acquired = 0; // Quantity of clocks received whilst estimating initial period
+        bool m_running = false;
+};
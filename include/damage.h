@@ -0,0 +1,126 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+#define DAMAGE_MAX_RECTS 8 // Maximum quantity of separate dirty rectangles per frame
+#define DAMAGE_MERGE_SLACK 512 // Maximum quantity of clean pixels pushed to save a separate rectangle
+
+struct rect_t {
+    int16_t x, y, w, h;
+};
+
+/*  List of regions of a canvas that have changed since last pushed to the display
+    Regions are merged when their bounding box adds few clean pixels, e.g. adjacent buttons but not crossing lines.
+    When the list is full the new region is merged with whichever existing region grows least.
+*/
+class DamageList {
+    public:
+        DamageList(int16_t w, int16_t h) : m_w(w), m_h(h) {
+        }
+
+        // Mark a region as dirty (clipped to the visible area)
+        void add(int16_t x, int16_t y, int16_t w, int16_t h) {
+            if (x < 0) {
+                w += x;
+                x = 0;
+            }
+            if (y < 0) {
+                h += y;
+                y = 0;
+            }
+            if (x + w > m_w)
+                w = m_w - x;
+            if (y + h > m_h)
+                h = m_h - y;
+            if (w <= 0 || h <= 0)
+                return;
+            rect_t r = {x, y, w, h};
+            // Absorb any regions that are cheap to merge, repeating as the new region grows
+            for (uint8_t i = 0; i < m_count;) {
+                if (area(merge(r, m_rects[i])) <= area(r) + area(m_rects[i]) + DAMAGE_MERGE_SLACK) {
+                    r = merge(r, m_rects[i]);
+                    m_rects[i] = m_rects[--m_count];
+                    i = 0;
+                } else {
+                    ++i;
+                }
+            }
+            if (m_count < DAMAGE_MAX_RECTS) {
+                m_rects[m_count++] = r;
+                return;
+            }
+            uint8_t best = 0;
+            uint32_t bestGrowth = UINT32_MAX;
+            for (uint8_t i = 0; i < m_count; ++i) {
+                rect_t u = merge(r, m_rects[i]);
+                uint32_t growth = area(u) - area(m_rects[i]);
+                if (growth < bestGrowth) {
+                    bestGrowth = growth;
+                    best = i;
+                }
+            }
+            r = merge(r, m_rects[best]);
+            m_rects[best] = m_rects[--m_count];
+            add(r.x, r.y, r.w, r.h);
+        }
+
+        // Mark whole visible area as dirty
+        void addAll() {
+            m_rects[0] = {0, 0, m_w, m_h};
+            m_count = 1;
+        }
+
+        void clear() {
+            m_count = 0;
+        }
+
+        uint8_t count() {
+            return m_count;
+        }
+
+        const rect_t& operator[](uint8_t i) {
+            return m_rects[i];
+        }
+
+        // Get quantity of dirty pixels
+        uint32_t pixels() {
+            uint32_t total = 0;
+            for (uint8_t i = 0; i < m_count; ++i)
+                total += area(m_rects[i]);
+            return total;
+        }
+
+    private:
+        static rect_t merge(const rect_t& a, const rect_t& b) {
+            int16_t x = a.x < b.x ? a.x : b.x;
+            int16_t y = a.y < b.y ? a.y : b.y;
+            int16_t x2 = a.x + a.w > b.x + b.w ? a.x + a.w : b.x + b.w;
+            int16_t y2 = a.y + a.h > b.y + b.h ? a.y + a.h : b.y + b.h;
+            return {x, y, (int16_t)(x2 - x), (int16_t)(y2 - y)};
+        }
+
+        static uint32_t area(const rect_t& r) {
+            return (uint32_t)r.w * r.h;
+        }
+
+        rect_t m_rects[DAMAGE_MAX_RECTS];
+        uint8_t m_count = 0;
+        int16_t m_w, m_h;
+};
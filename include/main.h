@@ -16,6 +16,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <cstdint>
+#include "blemidi.h"
+#include "ota.h"
+#include "profile.h"
+#include "touch.h"
 
 static const uint32_t PAD_COLOURS[] = {
     0x3186, // disabled
@@ -51,7 +55,7 @@ static const uint32_t PAD_COLOURS[] = {
     0x9bfd
 };
 
-static const char* BTN_LABELS[] = {
+static const char* const BTN_LABELS[] = {
     "\x86", // Menu
     "\x85", // Mixer
     "\x8C", //Ctrl
@@ -75,23 +79,163 @@ static const char* BTN_LABELS[] = {
     "\x88", //Page
 };
 
-static uint8_t BTN_IDS [] = {0, 13, 20, 16, 1, 18, 12, 17, 14,
+static const uint8_t BTN_IDS [] = {0, 13, 20, 16, 1, 18, 12, 17, 14,
                              2, 3, 20, 4, 5, 6, 8, 9, 10
     };
 
+enum gesture_enum {
+    GESTURE_TILT, // Wrist raised and turned towards face
+    GESTURE_DOUBLE_TAP,
+    GESTURE_FACE_UP, // Display turned to face up
+    GESTURE_FACE_DOWN, // Display turned to face down
+    GESTURE_COUNT
+};
+
+// MIDI message sent for an accelerometer gesture
+struct gesture_map_t {
+    uint8_t status; // Status byte without channel (0xB0 = CC, 0x90 = note on), 0 to not send
+    uint8_t data1; // CC / note number
+    uint8_t data2; // CC value / note velocity
+};
+
+// MIDI messages sent for each gesture (indexed by gesture_enum) on the configured MIDI channel
+static const gesture_map_t GESTURE_MAP[] = {
+    {0x00, 0, 0}, // Tilt only wakes display
+    {0xB0, 85, 127},
+    {0xB0, 86, 127},
+    {0xB0, 86, 0}
+};
+
+// Mapping of new profiles (name is set from profile index)
+static const profile_t DEFAULT_PROFILE = {
+    "", 15, 101, 102, 75, 76, 0,
+    {71, 72, 73, 74},
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {94, 95, 96, 97, 98, 99, 100, 101, 102, 103, 104, 105, 106, 107, 108, 109, 110, 111, 112, 113}
+};
+
+// MIDI message passed to MIDI task: incoming from BLE callback or outgoing from input task
+struct midi_event_t {
+    uint8_t status;
+    uint8_t data1;
+    uint8_t data2;
+    uint16_t timestamp;
+    uint32_t us; // Local time message was received or its input was sampled (us)
+    uint32_t due; // Local time incoming message should be applied (us), 0 for outgoing message
+};
+
+// Handles an incoming MIDI message in MIDI task
+typedef void (*midi_handler_t)(const midi_event_t& ev);
+
+// Incoming SysEx message body passed from BLE callback to MIDI task
+struct sysex_t {
+    uint8_t seq; // Sequence number (0..127) matching data1 of 0xF0 message
+    uint8_t len;
+    uint8_t data[BLE_MIDI_SYSEX_MAX];
+};
+
+// Firmware update command or image data passed from BLE callback to storage task
+struct ota_rx_t {
+    uint8_t type; // OTA_CMD_* for control write, OTA_DATA for data write
+    uint16_t len; // Quantity of bytes in data
+    uint32_t offset; // Image offset of data write
+    uint8_t data[OTA_CHUNK_MAX]; // Image bytes or command parameters
+};
+
+// Metronome beat passed from beat timer to render task
+struct beat_t {
+    uint8_t beat; // Beat within bar, 0 for first beat
+    uint32_t start; // Time beat fired (ms)
+    uint32_t period; // Duration of beat (ms), 0 if tempo too fast to measure
+};
+
 // Forward declarations
 void screenOn();
 void screenOff();
+void setPowerState(uint8_t);
+void configureCpu(uint8_t);
+void setSleepWake(bool);
 void refresh();
+void acquireTouch();
 void processTouch();
-bool processAccel();
+void onTouchEvent(const touch_event_t&);
+void onTouchIrq();
+void processAccel();
 void onPowerButtonLongPress();
 void onPowerButtonShortPress();
 void startBle();
 void toggleBle();
 void onBleConnect();
 void onBleDisconnect();
-void onMidiCC(uint8_t, uint8_t, uint8_t, uint16_t);
-void onMidiNoteOn(uint8_t, uint8_t, uint8_t, uint16_t);
+void onMidiPacket(const uint8_t*, uint16_t);
+void startOta();
+void onOtaWrite(uint8_t, const uint8_t*, uint16_t);
+void processOta();
+void beginOta(const ota_rx_t&);
+void writeOta(const ota_rx_t&);
+void endOta();
+void abortOta(uint8_t);
+void notifyOtaStatus(bool rewind=false);
+void updateOtaProgress();
+void confirmFirmware();
+void onMidiMessage(uint8_t, uint8_t, uint8_t, uint16_t);
+void onMidiSysex(const uint8_t*, uint8_t, uint16_t);
+void bindMidiHandlers();
+void armBeatTimer();
+void handleClock(const midi_event_t&);
+void onBeatTimer(void*);
+bool clockRunning();
+void applyBeats();
+void handleNoteOn(const midi_event_t&);
+void handleNoteOff(const midi_event_t&);
+void handleControlChange(const midi_event_t&);
+void storeControlChange(const midi_event_t&);
+void handleProgramChange(const midi_event_t&);
+void handleSysex(const midi_event_t&);
+void buildPadRamps();
+void updateNavigationButtons();
+uint8_t beatPhase();
+bool onIdle();
+void wakeInput();
+void lockUi();
+void unlockUi();
+void inputTask(void*);
+void midiTask(void*);
+void renderTask(void*);
+void storageTask(void*);
+void processInput();
+uint32_t processMidi();
+uint32_t processStorage(bool force=false);
+void sendMidi(uint8_t, uint8_t, uint8_t);
+void sendNoteOn(uint8_t, uint8_t, uint8_t);
+void sendControlChange(uint8_t, uint8_t, uint8_t);
+void flushMidi();
+void sendEncoderStep(uint8_t, int8_t);
+uint8_t encoderCc(uint8_t);
+void processThinning();
+bool tiltActive();
+uint8_t tiltToCc(int32_t);
+void processTilt();
+void onAccelIrq();
+void onGesture(uint8_t);
+void processRender();
 void showStatus();
-void numEntry();
\ No newline at end of file
+void showPerf();
+void dumpPerf();
+void initDisplay();
+void initDisplayQueue();
+void bootMark(uint8_t);
+void printBoot();
+bool displayIdle();
+void displayWait();
+void numEntry();
+void loadStorage();
+void loadSettings();
+void migrateSettings(uint16_t);
+void loadProfiles();
+void saveProfile(uint8_t);
+void selectProfile(uint8_t);
+void setProfileData(uint8_t, uint8_t, const uint8_t*, uint8_t);
+uint8_t* settingValue(uint8_t);
+bool loadLegacySettings();
+void saveSettings();
\ No newline at end of file
@@ -0,0 +1,112 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+#define ONE_EURO_TWO_PI 411775 // 2 x pi (Q16)
+
+/*  One euro filter (Casiez, Roussel & Vogel 2012) in fixed point for a fixed sample rate
+    Low pass filter whose cutoff rises with speed: slow movement is smoothed to remove jitter whilst fast movement is followed with little lag.
+    Uses integer arithmetic only with one division per sample (smoothing factor for the speed dependent cutoff). State is held with 8 fraction bits.
+*/
+class OneEuroFilter {
+    public:
+        /*  Configure and reset filter
+            rate: Sample rate (Hz)
+            minCutoff: Cutoff frequency when still (Hz x 256)
+            beta: Cutoff increase per unit/s of speed (Hz x 65536)
+            dCutoff: Cutoff frequency of speed estimate (Hz x 256)
+        */
+        void begin(uint16_t rate, uint32_t minCutoff, uint32_t beta, uint32_t dCutoff=256) {
+            m_rate = rate;
+            m_wPerHz = ((uint32_t)ONE_EURO_TWO_PI << 8) / rate;
+            m_minCutoff = minCutoff;
+            m_beta = beta;
+            m_dAlpha = alpha(dCutoff);
+            reset();
+        }
+
+        // Forget history - next sample is passed unfiltered
+        void reset() {
+            m_started = false;
+        }
+
+        // Filter a sample, returning filtered value
+        int32_t update(int32_t x) {
+            int32_t xq = x * 256;
+            if (!m_started) {
+                m_x = m_prev = xq;
+                m_dx = 0;
+                m_started = true;
+                return x;
+            }
+            int32_t dx = (xq - m_prev) * (int32_t)m_rate; // Speed (units/s x 256)
+            m_prev = xq;
+            m_dx += (int32_t)(((int64_t)dx - m_dx) * m_dAlpha >> 15);
+            uint32_t speed = (m_dx < 0 ? -m_dx : m_dx) >> 8;
+            uint32_t cutoff = m_minCutoff + (uint32_t)((uint64_t)m_beta * speed >> 8);
+            m_x += (int32_t)(((int64_t)xq - m_x) * alpha(cutoff) >> 15);
+            return value();
+        }
+
+        // Get last filtered value
+        int32_t value() const {
+            return (m_x + 128) >> 8;
+        }
+
+    private:
+        // Smoothing factor (Q15) for cutoff (Hz x 256): alpha = w / (w + 1) where w = 2 x pi x cutoff / rate
+        uint32_t alpha(uint32_t cutoff) const {
+            uint64_t w = (uint64_t)cutoff * m_wPerHz >> 16; // Q16
+            return (w << 15) / (w + 65536);
+        }
+
+        int32_t m_x = 0; // Filtered value (x 256)
+        int32_t m_prev = 0; // Previous raw value (x 256)
+        int32_t m_dx = 0; // Filtered speed (units/s x 256)
+        uint32_t m_minCutoff = 256;
+        uint32_t m_beta = 0;
+        uint32_t m_dAlpha = 0;
+        uint32_t m_wPerHz = (ONE_EURO_TWO_PI << 8) / 100; // 2 x pi / rate (Q24), so cutoff scaling needs no division
+        uint16_t m_rate = 100;
+        bool m_started = false;
+};
+
+/*  Passes a value only when it has moved at least a threshold from the last value passed
+    Range extremes are always passed so that they can be reached.
+*/
+class ChangeThreshold {
+    public:
+        // Returns true if value should be sent
+        bool update(uint8_t value, uint8_t threshold, uint8_t max=127) {
+            int16_t diff = (int16_t)value - m_value;
+            if (value == m_value || (diff < threshold && diff > -threshold && value != 0 && value != max))
+                return false;
+            m_value = value;
+            return true;
+        }
+
+        // Last value passed
+        uint8_t value() {
+            return m_value;
+        }
+
+    private:
+        uint8_t m_value = 255;
+};
@@ -0,0 +1,243 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include "sha256.h"
+
+/*  Firmware update over BLE
+    Control characteristic (write, notify):
+        Write <OTA_CMD_BEGIN> <image size u32> <SHA-256 of image>: start update, or resume if same image was partly received
+        Write <OTA_CMD_STATUS>: request status
+        Write <OTA_CMD_END>: all data sent - verify image and, if valid, restart into it
+        Write <OTA_CMD_ABORT>: abandon update
+        Notify <OTA_STATUS> <state> <error> <offset u32> <max chunk u16>: reply to each command, every OTA_PROGRESS_BYTES and on error
+        Notify <OTA_REWIND> <state> <error> <offset u32> <max chunk u16>: data was missed - client resends from offset
+    Data characteristic (write without response):
+        Write <offset u32> <image bytes>: up to max chunk image bytes at offset
+    All values are little endian.
+    Both characteristics require an encrypted link so the client must pair first. Commands other than STATUS and ABORT fail with OTA_ERR_DISABLED unless firmware update is allowed in settings.
+    Data writes are not acknowledged so the client streams them back to back. Writes must be in order: the first write that does not start at the next expected offset is dropped and OTA_REWIND reports the expected offset so the client resends from there. Later out of order writes are dropped silently until the expected offset arrives.
+    After BEGIN the client waits for status before sending data (flash is erased first). After END, if status shows data still missing, the client resends from offset and sends END again. After reconnecting the client sends BEGIN again to learn the offset to resume from.
+*/
+#define OTA_SERVICE_UUID "72696261-6e64-4f54-4100-000000000001"
+#define OTA_CONTROL_UUID "72696261-6e64-4f54-4100-000000000002"
+#define OTA_DATA_UUID "72696261-6e64-4f54-4100-000000000003"
+#define OTA_DATA_HEADER 4 // Size of offset preceding image bytes in data write
+#define OTA_CHUNK_MAX 508 // Most image bytes in one data write (largest attribute value 512 less header)
+#define OTA_BEGIN_SIZE 37 // Size of BEGIN command
+#define OTA_STATUS_SIZE 9 // Size of status notification
+#define OTA_PROGRESS_BYTES 65536 // Status is notified each time this much more of the image is received
+
+enum ota_command_enum {
+    OTA_DATA, // Image data (not a control command - used to queue data writes with commands)
+    OTA_CMD_BEGIN,
+    OTA_CMD_STATUS,
+    OTA_CMD_END,
+    OTA_CMD_ABORT,
+    OTA_STATUS = 0x80, // Status notification
+    OTA_REWIND // Status notification requesting data is resent from offset
+};
+
+enum ota_state_enum {
+    OTA_IDLE, // No update in progress
+    OTA_RECEIVING, // Waiting for data at offset
+    OTA_COMPLETE, // Image verified and selected to boot - restarting
+    OTA_FAILED // Update abandoned with error - BEGIN starts again
+};
+
+static const char* OTA_STATE_NAMES[] = {"idle", "receiving", "complete", "failed"};
+
+enum ota_error_enum {
+    OTA_OK,
+    OTA_ERR_COMMAND, // Unknown or malformed command
+    OTA_ERR_SIZE, // Image empty, too large for update partition or data beyond image size
+    OTA_ERR_FLASH, // Erase or write of update partition failed
+    OTA_ERR_HASH, // Image received does not match SHA-256
+    OTA_ERR_IMAGE, // Image matches SHA-256 but is not a valid application
+    OTA_ERR_DISABLED // Firmware update not allowed in settings
+};
+
+// Result of checking a data write
+enum ota_chunk_enum {
+    OTA_CHUNK_WRITE, // Next expected data - write to flash then call written()
+    OTA_CHUNK_DUPLICATE, // Already received - ignore
+    OTA_CHUNK_GAP, // First write after missing data - ignore and notify OTA_REWIND
+    OTA_CHUNK_SKIP, // Ignore (out of order after gap reported or no update in progress)
+    OTA_CHUNK_OVERRUN // Data beyond image size
+};
+
+// Status as notified to client
+struct ota_status_t {
+    bool rewind; // True if client must resend from offset (OTA_REWIND)
+    uint8_t state; // See ota_state_enum
+    uint8_t error; // See ota_error_enum
+    uint32_t offset; // Quantity of image bytes received, i.e. offset of next data expected
+    uint16_t maxChunk; // Most image bytes client may send in one data write
+};
+
+inline void otaPut32(uint8_t* p, uint32_t value) {
+    for (uint8_t i = 0; i < 4; ++i)
+        p[i] = value >> (8 * i);
+}
+
+inline uint32_t otaGet32(const uint8_t* p) {
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// Build BEGIN command in buf (OTA_BEGIN_SIZE bytes). Returns length.
+inline uint16_t otaPackBegin(uint8_t* buf, uint32_t size, const uint8_t* hash) {
+    buf[0] = OTA_CMD_BEGIN;
+    otaPut32(buf + 1, size);
+    memcpy(buf + 5, hash, SHA256_SIZE);
+    return OTA_BEGIN_SIZE;
+}
+
+// Build data write in buf (OTA_DATA_HEADER + len bytes). Returns length.
+inline uint16_t otaPackData(uint8_t* buf, uint32_t offset, const uint8_t* data, uint16_t len) {
+    otaPut32(buf, offset);
+    memcpy(buf + OTA_DATA_HEADER, data, len);
+    return OTA_DATA_HEADER + len;
+}
+
+// Build status notification in buf (OTA_STATUS_SIZE bytes). Returns length.
+inline uint16_t otaPackStatus(uint8_t* buf, const ota_status_t& status) {
+    buf[0] = status.rewind ? OTA_REWIND : OTA_STATUS;
+    buf[1] = status.state;
+    buf[2] = status.error;
+    otaPut32(buf + 3, status.offset);
+    buf[7] = status.maxChunk;
+    buf[8] = status.maxChunk >> 8;
+    return OTA_STATUS_SIZE;
+}
+
+// Decode status notification. Returns false if not a status notification.
+inline bool otaParseStatus(const uint8_t* buf, uint16_t len, ota_status_t& status) {
+    if (len < OTA_STATUS_SIZE || (buf[0] != OTA_STATUS && buf[0] != OTA_REWIND))
+        return false;
+    status.rewind = buf[0] == OTA_REWIND;
+    status.state = buf[1];
+    status.error = buf[2];
+    status.offset = otaGet32(buf + 3);
+    status.maxChunk = buf[7] | buf[8] << 8;
+    return true;
+}
+
+/*  Progress of image being received
+    Image data is accepted only in order so the digest is calculated as data arrives and the session can continue after a disconnect from the last byte written.
+    Flash is handled by the caller: erase / open on a new session, write each accepted chunk, then close and select for boot once verified.
+*/
+class OtaSession {
+    public:
+        /*  Start receiving an image, or continue receiving the same image
+            Returns true if resuming, false if a new session started (caller must prepare flash)
+        */
+        bool begin(uint32_t size, const uint8_t* hash) {
+            if (m_state == OTA_RECEIVING && size == m_size && memcmp(hash, m_hash, SHA256_SIZE) == 0) {
+                m_gapReported = false;
+                return true;
+            }
+            m_size = size;
+            memcpy(m_hash, hash, SHA256_SIZE);
+            m_offset = 0;
+            m_sha.begin();
+            m_state = OTA_RECEIVING;
+            m_error = OTA_OK;
+            m_gapReported = false;
+            return false;
+        }
+
+        // Classify data write of len bytes at offset - see ota_chunk_enum
+        uint8_t check(uint32_t offset, uint16_t len) {
+            if (m_state != OTA_RECEIVING)
+                return OTA_CHUNK_SKIP;
+            if (offset == m_offset)
+                return len <= m_size - m_offset ? OTA_CHUNK_WRITE : OTA_CHUNK_OVERRUN;
+            if (offset < m_offset)
+                return OTA_CHUNK_DUPLICATE;
+            if (m_gapReported)
+                return OTA_CHUNK_SKIP;
+            m_gapReported = true;
+            ++m_gaps;
+            return OTA_CHUNK_GAP;
+        }
+
+        // Record data accepted by check() that has been written to flash
+        void written(const uint8_t* data, uint16_t len) {
+            m_sha.update(data, len);
+            m_offset += len;
+            m_gapReported = false;
+        }
+
+        // True if all image data has been received
+        bool received() const {
+            return m_state == OTA_RECEIVING && m_offset == m_size;
+        }
+
+        // Check digest of received image. Call once all data is received. Fails session if image does not match.
+        bool verify() {
+            uint8_t digest[SHA256_SIZE];
+            m_sha.finish(digest);
+            if (memcmp(digest, m_hash, SHA256_SIZE) == 0)
+                return true;
+            fail(OTA_ERR_HASH);
+            return false;
+        }
+
+        void complete() {
+            m_state = OTA_COMPLETE;
+        }
+
+        // Abandon session with error (OTA_OK to abort without error)
+        void fail(uint8_t error) {
+            m_state = error == OTA_OK ? OTA_IDLE : OTA_FAILED;
+            m_error = error;
+        }
+
+        ota_status_t status(uint16_t maxChunk, bool rewind=false) const {
+            return {rewind, m_state, m_error, m_offset, maxChunk};
+        }
+
+        uint8_t state() const {
+            return m_state;
+        }
+
+        uint32_t offset() const {
+            return m_offset;
+        }
+
+        uint32_t size() const {
+            return m_size;
+        }
+
+        // Quantity of gaps in data reported since boot
+        uint32_t gaps() const {
+            return m_gaps;
+        }
+
+    private:
+        Sha256 m_sha; // Digest of data received
+        uint8_t m_hash[SHA256_SIZE]; // Expected digest of image
+        uint32_t m_size = 0; // Size of image
+        uint32_t m_offset = 0; // Quantity of image bytes received
+        uint32_t m_gaps = 0;
+        uint8_t m_state = OTA_IDLE;
+        uint8_t m_error = OTA_OK;
+        bool m_gapReported = false; // True if status has been sent for current gap
+};
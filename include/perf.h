@@ -0,0 +1,148 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#define PERF_SUB_BUCKETS 4 // Histogram buckets per power of 2 (resolution ~25%)
+#define PERF_BUCKETS (8 + 24 * PERF_SUB_BUCKETS) // Covers 0..~16s in us
+
+/*  Fixed size log-linear histogram of durations (us)
+    Values below 8 have their own bucket. Above that each power of 2 is split into PERF_SUB_BUCKETS.
+*/
+class LatencyHistogram {
+    public:
+        void clear() {
+            memset(m_counts, 0, sizeof(m_counts));
+            m_count = 0;
+            m_sum = 0;
+            m_min = UINT32_MAX;
+            m_max = 0;
+        }
+
+        void add(uint32_t us) {
+            ++m_counts[bucket(us)];
+            ++m_count;
+            m_sum += us;
+            if (us < m_min)
+                m_min = us;
+            if (us > m_max)
+                m_max = us;
+        }
+
+        // Add all values from another histogram
+        void add(const LatencyHistogram& other) {
+            for (uint16_t i = 0; i < PERF_BUCKETS; ++i)
+                m_counts[i] += other.m_counts[i];
+            m_count += other.m_count;
+            m_sum += other.m_sum;
+            if (other.m_min < m_min)
+                m_min = other.m_min;
+            if (other.m_max > m_max)
+                m_max = other.m_max;
+        }
+
+        uint32_t count() const {
+            return m_count;
+        }
+
+        uint32_t min() const {
+            return m_count ? m_min : 0;
+        }
+
+        uint32_t max() const {
+            return m_max;
+        }
+
+        uint32_t avg() const {
+            return m_count ? m_sum / m_count : 0;
+        }
+
+        // Get upper bound of bucket holding given percentile (0..100)
+        uint32_t percentile(uint8_t pc) const {
+            if (!m_count)
+                return 0;
+            uint32_t target = ((uint64_t)m_count * pc + 99) / 100;
+            uint32_t total = 0;
+            for (uint16_t i = 0; i < PERF_BUCKETS; ++i) {
+                total += m_counts[i];
+                if (total >= target) {
+                    uint32_t upper = upperBound(i);
+                    return upper < m_max ? upper : m_max;
+                }
+            }
+            return m_max;
+        }
+
+    private:
+        static uint16_t bucket(uint32_t us) {
+            if (us < 8)
+                return us;
+            uint8_t msb = 31 - __builtin_clz(us);
+            uint16_t sub = (us >> (msb - 2)) & (PERF_SUB_BUCKETS - 1);
+            uint16_t i = 8 + (msb - 3) * PERF_SUB_BUCKETS + sub;
+            return i < PERF_BUCKETS ? i : PERF_BUCKETS - 1;
+        }
+
+        static uint32_t upperBound(uint16_t i) {
+            if (i < 8)
+                return i;
+            uint8_t msb = (i - 8) / PERF_SUB_BUCKETS + 3;
+            uint32_t sub = (i - 8) % PERF_SUB_BUCKETS;
+            return (1UL << msb) + ((sub + 1) << (msb - 2)) - 1;
+        }
+
+        uint32_t m_counts[PERF_BUCKETS] = {};
+        uint32_t m_count = 0;
+        uint64_t m_sum = 0;
+        uint32_t m_min = UINT32_MAX;
+        uint32_t m_max = 0;
+};
+
+/*  Rolling latency statistics
+    Values are added to the current window. roll() starts a new window and reports cover the current and previous windows.
+*/
+class LatencyStats {
+    public:
+        void add(uint32_t us) {
+            m_windows[m_current].add(us);
+        }
+
+        // Start a new window, discarding the oldest
+        void roll() {
+            m_current = !m_current;
+            m_windows[m_current].clear();
+        }
+
+        void clear() {
+            m_windows[0].clear();
+            m_windows[1].clear();
+        }
+
+        // Get histogram of current and previous window
+        LatencyHistogram get() const {
+            LatencyHistogram result = m_windows[0];
+            result.add(m_windows[1]);
+            return result;
+        }
+
+    private:
+        LatencyHistogram m_windows[2];
+        uint8_t m_current = 0;
+};
@@ -0,0 +1,100 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#define POWER_MAX_STATES 8 // Maximum quantity of power states tracked
+
+/*  Time spent in each power state and battery charge used
+    Charge is estimated from the time in each state and a typical current for that state, not measured.
+*/
+class PowerResidency {
+    public:
+        /*  Configure states
+            currents: Estimated battery current in each state (mA)
+            count: Quantity of states
+        */
+        PowerResidency(const uint16_t* currents, uint8_t count) : m_currents(currents), m_count(count < POWER_MAX_STATES ? count : POWER_MAX_STATES) {
+            clear(0);
+        }
+
+        // Record change of state at time now (ms)
+        void enter(uint8_t state, uint32_t now) {
+            update(now);
+            if (state < m_count && state != m_state) {
+                m_state = state;
+                ++m_entries[state];
+            }
+        }
+
+        // Reset counters, keeping current state
+        void clear(uint32_t now) {
+            memset(m_ms, 0, sizeof(m_ms));
+            memset(m_entries, 0, sizeof(m_entries));
+            m_since = now;
+        }
+
+        uint8_t state() const {
+            return m_state;
+        }
+
+        // Time spent in a state (ms) up to time now
+        uint32_t residency(uint8_t state, uint32_t now) const {
+            if (state >= m_count)
+                return 0;
+            return m_ms[state] + (state == m_state ? now - m_since : 0);
+        }
+
+        // Quantity of times a state has been entered
+        uint32_t entries(uint8_t state) const {
+            return state < m_count ? m_entries[state] : 0;
+        }
+
+        // Estimated charge used up to time now (uAh)
+        uint32_t charge(uint32_t now) const {
+            uint64_t total = 0; // mA x ms
+            for (uint8_t i = 0; i < m_count; ++i)
+                total += (uint64_t)residency(i, now) * m_currents[i];
+            return total / 3600;
+        }
+
+        // Estimated average current up to time now (mA x 10)
+        uint32_t averageCurrent(uint32_t now) const {
+            uint64_t total = 0, ms = 0;
+            for (uint8_t i = 0; i < m_count; ++i) {
+                total += (uint64_t)residency(i, now) * m_currents[i];
+                ms += residency(i, now);
+            }
+            return ms ? total * 10 / ms : 0;
+        }
+
+    private:
+        void update(uint32_t now) {
+            m_ms[m_state] += now - m_since;
+            m_since = now;
+        }
+
+        const uint16_t* m_currents;
+        uint8_t m_count;
+        uint8_t m_state = 0;
+        uint32_t m_since = 0; // Time current state was entered or last accounted (ms)
+        uint32_t m_ms[POWER_MAX_STATES]; // Time spent in each state, excluding current period (ms)
+        uint32_t m_entries[POWER_MAX_STATES];
+};
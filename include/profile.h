@@ -0,0 +1,105 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "settings.h"
+
+#define PROFILE_COUNT 8 // Quantity of stored profiles
+#define PROFILE_NAME_SIZE 12 // Maximum length of profile name including terminator
+#define PROFILE_PADS 16 // Quantity of launch pads mapped by a profile
+#define PROFILE_NAV_BUTTONS 20 // Quantity of navigation button IDs mapped by a profile
+#define PROFILE_ENCODERS 4 // Quantity of encoder strips mapped by a profile
+#define PROFILE_NO_PAD 255 // Value of padForNote() for notes not mapped to a pad
+
+// Stored definition of a performance profile - how controls map to MIDI
+struct profile_t {
+    char name[PROFILE_NAME_SIZE];
+    uint8_t midiChan; // MIDI channel of pads, X-Y, encoders and feedback (0..15)
+    uint8_t ccX; // X-Y pad horizontal controller
+    uint8_t ccY; // X-Y pad vertical controller
+    uint8_t metroHigh; // Note that triggers first beat of bar metronome pulse
+    uint8_t metroLow; // Note that triggers other beats metronome pulse
+    uint8_t encMode; // Encoder strip mode (0: relative steps, 1: absolute value)
+    uint8_t encCc[PROFILE_ENCODERS]; // Controller of each encoder strip
+    uint8_t padNotes[PROFILE_PADS]; // Note of each launch pad
+    uint8_t navNotes[PROFILE_NAV_BUTTONS]; // Note of each navigation button ID (sent on channel 16)
+};
+
+/*  Profile as stored in flash
+    Fields are only ever appended to profile_t so a record holding a smaller profile (written by older firmware) provides the first fields and the rest keep their defaults.
+    Only length() bytes are stored.
+*/
+struct profile_record_t {
+    uint16_t version; // Schema version of stored profile
+    uint16_t size; // Size of stored profile
+    uint32_t crc; // CRC-32 of version, size and stored profile
+    profile_t profile;
+
+    // Fill record from profile
+    void pack(uint16_t ver, const profile_t& src) {
+        version = ver;
+        size = sizeof(profile_t);
+        profile = src;
+        crc = calcCrc();
+    }
+
+    // True if record of given stored length is intact
+    bool valid(uint32_t len) const {
+        return len >= offsetof(profile_record_t, profile) && size <= sizeof(profile_t) && len == length() && crc == calcCrc();
+    }
+
+    // Copy stored fields to profile
+    void unpack(profile_t& dst) const {
+        memcpy(&dst, &profile, size);
+        dst.name[PROFILE_NAME_SIZE - 1] = '\0';
+    }
+
+    // Quantity of bytes to store
+    uint32_t length() const {
+        return offsetof(profile_record_t, profile) + size;
+    }
+
+    uint32_t calcCrc() const {
+        return crc32Block(&profile, size, crc32Block(this, offsetof(profile_record_t, crc)));
+    }
+};
+
+/*  Performance profile with lookup tables derived from its definition
+    Tables are rebuilt by compile() when the definition changes so that switching profile is only a change of pointer and each incoming note maps to its pad with one lookup.
+*/
+class Profile : public profile_t {
+    public:
+        // Rebuild lookup tables from definition
+        void compile() {
+            midiChan &= 0x0F;
+            memset(m_padForNote, PROFILE_NO_PAD, sizeof(m_padForNote));
+            for (uint8_t pad = PROFILE_PADS; pad-- > 0;)
+                m_padForNote[padNotes[pad] & 0x7F] = pad; // Lowest pad wins if a note is mapped more than once
+        }
+
+        // Get pad mapped to a note or PROFILE_NO_PAD
+        uint8_t padForNote(uint8_t note) const {
+            return m_padForNote[note & 0x7F];
+        }
+
+    private:
+        uint8_t m_padForNote[128];
+};
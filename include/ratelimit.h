@@ -0,0 +1,126 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+/*  Thins an absolute controller value stream
+    At most one value is sent per window. Values arriving within the window replace each other and the last is sent when the window expires.
+*/
+class RateLimiter {
+    public:
+        /*  Offer a new value
+            now: Current time (ms)
+            window: Minimum time between sent values (ms)
+            Returns true if value should be sent now, false if held back
+        */
+        bool update(uint8_t value, uint32_t now, uint32_t window) {
+            if (now - m_lastSent >= window) {
+                m_lastSent = now;
+                m_held = false;
+                return true;
+            }
+            if (m_held)
+                ++m_coalesced;
+            m_value = value;
+            m_held = true;
+            return false;
+        }
+
+        /*  Check for a held value that is now due
+            value: Set to value to send
+            Returns true if value should be sent now
+        */
+        bool poll(uint32_t now, uint32_t window, uint8_t& value) {
+            if (!m_held || now - m_lastSent < window)
+                return false;
+            value = m_value;
+            m_lastSent = now;
+            m_held = false;
+            return true;
+        }
+
+        bool held() {
+            return m_held;
+        }
+
+        // Quantity of values dropped in favour of a later value
+        uint32_t coalesced() {
+            return m_coalesced;
+        }
+
+    private:
+        uint32_t m_lastSent = 0;
+        uint32_t m_coalesced = 0;
+        uint8_t m_value = 0;
+        bool m_held = false;
+};
+
+#define STEP_LIMIT_MAX 8 // Maximum quantity of relative steps held back
+
+/*  Paces a relative (encoder step) stream
+    Steps cannot be merged without losing movement so at most one step is sent per window and the remainder is held, up to STEP_LIMIT_MAX.
+    A change of direction cancels held steps.
+*/
+class StepLimiter {
+    public:
+        /*  Offer a step
+            step: Direction (+1 or -1)
+            Returns true if step should be sent now
+        */
+        bool update(int8_t step, uint32_t now, uint32_t window) {
+            if ((step > 0) != (m_pending > 0))
+                m_pending = 0;
+            if (m_pending == 0 && now - m_lastSent >= window) {
+                m_lastSent = now;
+                return true;
+            }
+            if (m_pending < STEP_LIMIT_MAX && m_pending > -STEP_LIMIT_MAX)
+                m_pending += step;
+            else
+                ++m_dropped;
+            return false;
+        }
+
+        /*  Check for a held step that is now due
+            step: Set to direction of step to send
+            Returns true if step should be sent now
+        */
+        bool poll(uint32_t now, uint32_t window, int8_t& step) {
+            if (!m_pending || now - m_lastSent < window)
+                return false;
+            step = m_pending > 0 ? 1 : -1;
+            m_pending -= step;
+            m_lastSent = now;
+            return true;
+        }
+
+        bool held() {
+            return m_pending != 0;
+        }
+
+        // Quantity of steps discarded because too many were held
+        uint32_t dropped() {
+            return m_dropped;
+        }
+
+    private:
+        uint32_t m_lastSent = 0;
+        uint32_t m_dropped = 0;
+        int8_t m_pending = 0;
+};
@@ -0,0 +1,169 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+#define SCROLL_FLING_MIN 150 // Slowest release speed that starts a fling (pixels per second)
+#define SCROLL_FRICTION 1200 // Deceleration of fling (pixels per second per second)
+#define SCROLL_HOLD_US 60000 // Release this long after last movement does not fling (us)
+
+/*  Scroll position of a vertical list of equally spaced rows with fling
+    Only rows from firstVisible() to endVisible() intersect the view so drawing and hit testing cost depends on the height of the view, not the quantity of rows.
+    Position is held in 1/256 pixel so that slow flings still move.
+*/
+class ScrollList {
+    public:
+        /*  Configure list
+            pitch: Distance between start of each row (pixels)
+            view: Height of visible area (pixels)
+            count: Quantity of rows
+        */
+        ScrollList(uint16_t pitch, uint16_t view, uint16_t count) : m_pitch(pitch), m_view(view), m_count(count) {}
+
+        void setCount(uint16_t count) {
+            m_count = count;
+            setOffset(offset());
+        }
+
+        // Quantity of pixels list is scrolled up
+        int32_t offset() const {
+            return m_pos >> 8;
+        }
+
+        void setOffset(int32_t offset) {
+            m_pos = clamp(offset << 8);
+        }
+
+        // Largest offset, showing last row at bottom of view
+        int32_t maxOffset() const {
+            int32_t height = (int32_t)m_count * m_pitch;
+            return height > m_view ? height - m_view : 0;
+        }
+
+        // Index of first row in view
+        uint16_t firstVisible() const {
+            return offset() / m_pitch;
+        }
+
+        // Index after last row in view
+        uint16_t endVisible() const {
+            uint32_t end = (offset() + m_view + m_pitch - 1) / m_pitch;
+            return end < m_count ? end : m_count;
+        }
+
+        // Position of top of row within view
+        int16_t rowY(uint16_t row) const {
+            return row * m_pitch - offset();
+        }
+
+        // Index of row at position within view, -1 if none
+        int16_t rowAt(int16_t y) const {
+            if (y < 0 || y >= m_view)
+                return -1;
+            uint32_t row = (y + offset()) / m_pitch;
+            return row < m_count ? row : -1;
+        }
+
+        // Finger down - stops any fling. Returns true if list was moving.
+        bool press() {
+            bool wasMoving = m_velocity != 0;
+            m_velocity = 0;
+            m_dragVelocity = 0;
+            m_dragging = false;
+            m_lastUs = 0;
+            return wasMoving;
+        }
+
+        /*  Finger moved
+            delta: Change of offset (pixels, positive scrolls list up)
+            us: Time of touch sample (us)
+        */
+        void drag(int16_t delta, uint32_t us) {
+            setOffset(offset() + delta);
+            uint32_t dt = us - m_lastUs;
+            if (m_lastUs && dt) {
+                int32_t velocity = (int64_t)delta * 1000000 / dt;
+                m_dragVelocity = m_dragging ? (m_dragVelocity + velocity) / 2 : velocity; // Smooth speed over recent samples
+                m_dragging = true;
+            }
+            m_lastUs = us;
+        }
+
+        // Finger lifted at time us - fling at speed of recent drag if finger was still moving
+        void release(uint32_t us) {
+            int32_t speed = m_dragVelocity < 0 ? -m_dragVelocity : m_dragVelocity;
+            if (m_lastUs && us - m_lastUs < SCROLL_HOLD_US && speed >= SCROLL_FLING_MIN)
+                m_velocity = m_dragVelocity;
+            m_dragVelocity = 0;
+            m_lastUs = us;
+        }
+
+        /*  Advance fling to time us
+            Returns true if offset changed
+        */
+        bool update(uint32_t us) {
+            if (!m_velocity)
+                return false;
+            uint32_t dt = us - m_lastUs;
+            m_lastUs = us;
+            if (dt > 100000)
+                dt = 100000; // Avoid a jump after a stall
+            int32_t last = offset();
+            int32_t pos = clamp(m_pos + (int64_t)m_velocity * dt * 256 / 1000000);
+            int32_t slow = (int64_t)SCROLL_FRICTION * dt / 1000000;
+            if (slow < 1)
+                slow = 1;
+            if (pos == 0 || pos == (maxOffset() << 8) || (m_velocity < 0 ? -m_velocity : m_velocity) <= slow)
+                m_velocity = 0; // Reached end or stopped
+            else
+                m_velocity += m_velocity < 0 ? slow : -slow;
+            m_pos = pos;
+            return offset() != last;
+        }
+
+        // True whilst flinging
+        bool moving() const {
+            return m_velocity != 0;
+        }
+
+        // Position and length of scrollbar thumb in a track of given length
+        void thumb(int16_t track, int16_t& y, int16_t& h) const {
+            int32_t height = (int32_t)m_count * m_pitch;
+            h = height > m_view ? (int32_t)track * m_view / height : track;
+            y = maxOffset() ? offset() * (track - h) / maxOffset() : 0;
+        }
+
+    private:
+        int32_t clamp(int32_t pos) const {
+            if (pos < 0)
+                return 0;
+            if (pos > (maxOffset() << 8))
+                return maxOffset() << 8;
+            return pos;
+        }
+
+        uint16_t m_pitch;
+        uint16_t m_view;
+        uint16_t m_count;
+        int32_t m_pos = 0; // Offset (1/256 pixel)
+        int32_t m_velocity = 0; // Fling speed (pixels per second, positive scrolls list up)
+        int32_t m_dragVelocity = 0; // Smoothed speed of finger whilst dragging (pixels per second)
+        uint32_t m_lastUs = 0; // Time of last drag sample or fling update (us), 0 if none
+        bool m_dragging = false; // True once drag speed has been measured
+};
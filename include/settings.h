@@ -0,0 +1,69 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#define SETTINGS_MAX 32 // Maximum quantity of settings a record can hold
+
+// CRC-32 (IEEE 802.3, as zlib) of a block of data. Pass previous result to continue over several blocks.
+inline uint32_t crc32Block(const void* data, uint32_t len, uint32_t crc=0) {
+    const uint8_t* p = (const uint8_t*)data;
+    crc = ~crc;
+    while (len--) {
+        crc ^= *p++;
+        for (uint8_t bit = 0; bit < 8; ++bit)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+/*  Settings as stored in flash
+    Settings are only ever appended so a record holding fewer values (written by older firmware) provides the first values and the rest keep their defaults.
+    Version identifies the meaning of the stored values and is incremented when an existing setting changes meaning or range so that it can be converted when loaded.
+*/
+struct settings_record_t {
+    uint16_t version; // Schema version of stored values
+    uint8_t count; // Quantity of values stored
+    uint8_t reserved;
+    uint8_t values[SETTINGS_MAX];
+    uint32_t crc; // CRC-32 of preceding fields
+
+    // Fill record from settings
+    void pack(uint16_t ver, const uint8_t* settings, uint8_t len) {
+        memset(this, 0, sizeof(*this));
+        version = ver;
+        count = len < SETTINGS_MAX ? len : SETTINGS_MAX;
+        memcpy(values, settings, count);
+        crc = crc32Block(this, offsetof(settings_record_t, crc));
+    }
+
+    // True if record is intact
+    bool valid() const {
+        return count <= SETTINGS_MAX && crc == crc32Block(this, offsetof(settings_record_t, crc));
+    }
+
+    // Copy stored values to settings, returning quantity copied
+    uint8_t unpack(uint8_t* settings, uint8_t len) const {
+        uint8_t n = count < len ? count : len;
+        memcpy(settings, values, n);
+        return n;
+    }
+};
@@ -0,0 +1,59 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <mbedtls/sha256.h>
+
+#define SHA256_SIZE 32 // Size of SHA-256 digest (bytes)
+
+/*  SHA-256 digest of data passed in any quantity of blocks
+    Used to check a firmware image received in chunks. Uses the ESP32 hardware accelerated mbedtls implementation.
+*/
+class Sha256 {
+    public:
+        Sha256() {
+            mbedtls_sha256_init(&m_ctx);
+            begin();
+        }
+
+        ~Sha256() {
+            mbedtls_sha256_free(&m_ctx);
+        }
+
+        Sha256(const Sha256&) = delete;
+        Sha256& operator=(const Sha256&) = delete;
+
+        // Start new digest
+        void begin() {
+            mbedtls_sha256_starts_ret(&m_ctx, 0);
+        }
+
+        // Add data to digest
+        void update(const void* data, uint32_t len) {
+            mbedtls_sha256_update_ret(&m_ctx, (const unsigned char*)data, len);
+        }
+
+        // Complete digest and write to digest (SHA256_SIZE bytes). Call begin() before reusing.
+        void finish(uint8_t* digest) {
+            mbedtls_sha256_finish_ret(&m_ctx, digest);
+        }
+
+    private:
+        mbedtls_sha256_context m_ctx; // mbedtls digest state
+};
@@ -0,0 +1,93 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/*  Fixed size, lock-free, single producer / single consumer queue
+    One task (or callback) may push and one other task may pop. No memory is allocated.
+    N must be a power of 2.
+*/
+template <typename T, uint32_t N>
+class SpscQueue {
+    static_assert(N && (N & (N - 1)) == 0, "SpscQueue size must be a power of 2");
+
+    public:
+        // Add an item (producer only). Returns false and counts an overflow if full.
+        bool push(const T& item) {
+            uint32_t head = m_head.load(std::memory_order_relaxed);
+            uint32_t used = head - m_tail.load(std::memory_order_acquire);
+            if (used >= N) {
+                m_overflows.store(m_overflows.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return false;
+            }
+            m_items[head & (N - 1)] = item;
+            m_head.store(head + 1, std::memory_order_release);
+            if (used + 1 > m_highWater.load(std::memory_order_relaxed))
+                m_highWater.store(used + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        // Remove up to max items into a buffer (consumer only). Returns quantity of items removed.
+        uint32_t pop(T* items, uint32_t max) {
+            uint32_t tail = m_tail.load(std::memory_order_relaxed);
+            uint32_t count = m_head.load(std::memory_order_acquire) - tail;
+            if (count > max)
+                count = max;
+            for (uint32_t i = 0; i < count; ++i)
+                items[i] = m_items[(tail + i) & (N - 1)];
+            m_tail.store(tail + count, std::memory_order_release);
+            return count;
+        }
+
+        // Remove one item (consumer only). Returns false if empty.
+        bool pop(T& item) {
+            return pop(&item, 1) == 1;
+        }
+
+        // Copy oldest item without removing it (consumer only). Returns false if empty.
+        bool peek(T& item) {
+            uint32_t tail = m_tail.load(std::memory_order_relaxed);
+            if (m_head.load(std::memory_order_acquire) == tail)
+                return false;
+            item = m_items[tail & (N - 1)];
+            return true;
+        }
+
+        bool empty() {
+            return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+        }
+
+        // Quantity of items rejected because queue was full
+        uint32_t overflows() {
+            return m_overflows.load(std::memory_order_relaxed);
+        }
+
+        // Maximum quantity of items held at once
+        uint32_t highWater() {
+            return m_highWater.load(std::memory_order_relaxed);
+        }
+
+    private:
+        T m_items[N];
+        std::atomic<uint32_t> m_head{0}; // Total items pushed (written by producer)
+        std::atomic<uint32_t> m_tail{0}; // Total items popped (written by consumer)
+        std::atomic<uint32_t> m_overflows{0};
+        std::atomic<uint32_t> m_highWater{0};
+};
@@ -0,0 +1,95 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+#define TOUCH_RELEASE_US 30000 // Touch must be absent from samples for this long before release is reported (us)
+
+// Touch controller sample
+struct touch_sample_t {
+    uint32_t us; // Time sample was taken, i.e. time of touch interrupt (us)
+    int16_t x, y;
+    bool down; // True if touched
+};
+
+enum touch_event_enum {
+    TOUCH_NONE,
+    TOUCH_DOWN, // Touch started
+    TOUCH_MOVE, // Touch continues (position may have changed)
+    TOUCH_UP // Touch ended
+};
+
+struct touch_event_t {
+    uint8_t type; // See touch_event_enum
+    uint32_t us; // Time of sample that caused the event (us)
+    int16_t x, y;
+};
+
+/*  Debounces touch samples using the time each sample was taken
+    Touch is reported by the first touched sample. Release is only reported once no touched sample follows the first untouched sample within TOUCH_RELEASE_US so that chatter as a finger lands or lifts, or brief loss of contact whilst dragging, does not end the touch.
+    Release event time is that of the first untouched sample.
+*/
+class TouchFilter {
+    public:
+        // Process a sample, returning the resulting event (TOUCH_NONE if sample is absorbed)
+        touch_event_t update(const touch_sample_t& sample) {
+            if (sample.down) {
+                m_x = sample.x;
+                m_y = sample.y;
+                m_releasePending = false;
+                if (m_down)
+                    return {TOUCH_MOVE, sample.us, m_x, m_y};
+                m_down = true;
+                return {TOUCH_DOWN, sample.us, m_x, m_y};
+            }
+            if (m_down && !m_releasePending) {
+                m_releasePending = true;
+                m_liftUs = sample.us;
+            }
+            return poll(sample.us);
+        }
+
+        // Report release if no touch has been sampled for long enough by time us
+        touch_event_t poll(uint32_t us) {
+            if (!m_releasePending || (int32_t)(us - m_liftUs) < TOUCH_RELEASE_US)
+                return {TOUCH_NONE, us, m_x, m_y};
+            m_down = false;
+            m_releasePending = false;
+            return {TOUCH_UP, m_liftUs, m_x, m_y};
+        }
+
+        // True if touch has been reported and not yet released
+        bool down() const {
+            return m_down;
+        }
+
+        // Time remaining until a pending release is reported (us), 0 if none pending
+        uint32_t releaseDue(uint32_t us) const {
+            if (!m_releasePending)
+                return 0;
+            int32_t remaining = TOUCH_RELEASE_US - (int32_t)(us - m_liftUs);
+            return remaining > 0 ? remaining : 1;
+        }
+
+    private:
+        uint32_t m_liftUs = 0; // Time of first untouched sample of pending release (us)
+        int16_t m_x = 0, m_y = 0; // Last touched position
+        bool m_down = false;
+        bool m_releasePending = false;
+};
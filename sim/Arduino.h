@@ -0,0 +1,70 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*  Host simulator stub - Minimal Arduino core replacement for the native build.
+*/
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define PROGMEM
+#define IRAM_ATTR
+#define INPUT 0x01
+#define INPUT_PULLUP 0x05
+#define OUTPUT 0x03
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+#define LOW 0
+#define HIGH 1
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint8_t pin, void (*isr)(), int mode);
+bool setCpuFrequencyMhz(uint32_t mhz);
+uint32_t getCpuFrequencyMhz();
+
+// PSRAM is modelled as ordinary heap
+inline bool psramFound() { return true; }
+inline void* ps_malloc(size_t size) { return malloc(size); }
+
+class HardwareSerial {
+    public:
+        void begin(uint32_t baud) {}
+        int available();
+        int read();
+        int print(const char* s) { return ::printf("%s", s); }
+        int println(const char* s="") { return ::printf("%s\n", s); }
+        int printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+            va_list args;
+            va_start(args, fmt);
+            int n = ::vprintf(fmt, args);
+            va_end(args);
+            return n;
+        }
+};
+
+extern HardwareSerial Serial;
@@ -0,0 +1,159 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*  Host simulator stub - Stand-in for the ESP32 Bluedroid BLE classes used to reach the BLE MIDI characteristic and add services.
+    Notified packets are kept so the simulator can inspect them. Access permissions are kept so the simulator can refuse writes over an unencrypted link, as Bluedroid does.
+*/
+#pragma once
+
+#include "Arduino.h"
+#include <map>
+#include <string>
+#include <vector>
+
+#define SIM_BLE_MIDI_SERVICE_UUID "03b80e5a-ede8-4b33-a751-6ce34ec4c700" // Service created by BLEMidiServer
+
+typedef enum {
+    ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT = 20,
+} esp_gap_ble_cb_event_t;
+
+typedef union {
+    struct {
+        uint16_t min_int, max_int, latency, conn_int, timeout;
+    } update_conn_params;
+} esp_ble_gap_cb_param_t;
+
+typedef enum {
+    ESP_GATTS_WRITE_EVT = 2,
+    ESP_GATTS_MTU_EVT = 4,
+} esp_gatts_cb_event_t;
+
+typedef uint8_t esp_gatt_if_t;
+
+typedef uint16_t esp_gatt_perm_t;
+#define ESP_GATT_PERM_READ (1 << 0)
+#define ESP_GATT_PERM_READ_ENCRYPTED (1 << 1)
+#define ESP_GATT_PERM_WRITE (1 << 4)
+#define ESP_GATT_PERM_WRITE_ENCRYPTED (1 << 5)
+
+typedef struct {
+    uint8_t bda[6];
+    uint16_t min_int, max_int, latency, timeout;
+} esp_ble_conn_update_params_t;
+
+// Requests connection parameters - simulator applies maximum interval at once
+int esp_ble_gap_update_conn_params(esp_ble_conn_update_params_t* params);
+
+typedef union {
+    struct {
+        uint16_t conn_id;
+        uint16_t mtu;
+    } mtu;
+    struct {
+        uint16_t conn_id;
+        uint32_t trans_id;
+        uint8_t bda[6];
+        uint16_t handle;
+        uint16_t offset;
+        bool need_rsp;
+        bool is_prep;
+        uint16_t len;
+        uint8_t* value;
+    } write;
+} esp_ble_gatts_cb_param_t;
+
+class BLECharacteristic;
+
+class BLECharacteristicCallbacks {
+    public:
+        virtual ~BLECharacteristicCallbacks() {}
+        virtual void onWrite(BLECharacteristic* characteristic) {}
+};
+
+class BLEDescriptor {
+    public:
+        virtual ~BLEDescriptor() {}
+        void setAccessPermissions(esp_gatt_perm_t perm) { permissions = perm; }
+
+        esp_gatt_perm_t permissions = ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE;
+};
+
+class BLECharacteristic {
+    public:
+        static const uint32_t PROPERTY_READ = 1 << 0;
+        static const uint32_t PROPERTY_WRITE = 1 << 1;
+        static const uint32_t PROPERTY_NOTIFY = 1 << 2;
+        static const uint32_t PROPERTY_WRITE_NR = 1 << 5;
+
+        BLECharacteristic(uint16_t handle=42) : m_handle(handle) {}
+        void setValue(uint8_t* data, size_t size) { m_value.assign(data, data + size); }
+        std::string getValue() { return std::string(m_value.begin(), m_value.end()); }
+        uint8_t* getData() { return m_value.data(); }
+        uint16_t getHandle() { return m_handle; }
+        void notify(bool confirm=true) { notified.push_back(m_value); }
+        void setCallbacks(BLECharacteristicCallbacks* callbacks) { this->callbacks = callbacks; }
+        void addDescriptor(BLEDescriptor* descriptor) { descriptors.push_back(descriptor); }
+        void setAccessPermissions(esp_gatt_perm_t perm) { permissions = perm; }
+
+        std::vector<std::vector<uint8_t>> notified; // Packets sent to central
+        esp_gatt_perm_t permissions = ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE;
+        BLECharacteristicCallbacks* callbacks = nullptr;
+        std::vector<BLEDescriptor*> descriptors;
+
+    private:
+        std::vector<uint8_t> m_value;
+        uint16_t m_handle;
+};
+
+class BLEService {
+    public:
+        BLECharacteristic* createCharacteristic(const char* uuid, uint32_t properties) {
+            static uint16_t nextHandle = 43; // MIDI characteristic has 42
+            return &characteristics.emplace(uuid, nextHandle++).first->second;
+        }
+        BLECharacteristic* getCharacteristic(const char* uuid) {
+            auto it = characteristics.find(uuid);
+            return it == characteristics.end() ? &midi : &it->second;
+        }
+        void start() {}
+        BLECharacteristic midi;
+        std::map<std::string, BLECharacteristic> characteristics; // Characteristics added by firmware
+};
+
+class BLEServer {
+    public:
+        BLEService* createService(const char* uuid) { return &services[uuid]; }
+        BLEService* getServiceByUUID(const char* uuid) {
+            if (std::string(uuid) == SIM_BLE_MIDI_SERVICE_UUID)
+                return &service;
+            auto it = services.find(uuid);
+            return it == services.end() ? nullptr : &it->second;
+        }
+        BLEService service;
+        std::map<std::string, BLEService> services; // Services added by firmware
+};
+
+class BLEDevice {
+    public:
+        static BLEServer* getServer() { return m_pServer; }
+        static void setCustomGapHandler(void (*handler)(esp_gap_ble_cb_event_t, esp_ble_gap_cb_param_t*)) { gapHandler = handler; }
+        static void setCustomGattsHandler(void (*handler)(esp_gatts_cb_event_t, esp_gatt_if_t, esp_ble_gatts_cb_param_t*)) { gattsHandler = handler; }
+
+        static BLEServer* m_pServer;
+        static void (*gapHandler)(esp_gap_ble_cb_event_t, esp_ble_gap_cb_param_t*);
+        static void (*gattsHandler)(esp_gatts_cb_event_t, esp_gatt_if_t, esp_ble_gatts_cb_param_t*);
+};
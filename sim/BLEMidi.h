@@ -0,0 +1,56 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*  Host simulator stub - Stand-in for ESP32-BLE-MIDI that logs outgoing messages.
+*/
+#pragma once
+
+#include "Arduino.h"
+#include "BLEDevice.h"
+#include "sim.h"
+
+class BLEMidiServerClass {
+    public:
+        void begin(const char* name) {
+            simBootStep("advertise");
+            static BLEServer server;
+            BLEDevice::m_pServer = &server;
+            running = true;
+        }
+        void end() {
+            BLEDevice::m_pServer = nullptr;
+            running = false;
+            connected = false;
+        }
+        bool isConnected() { return connected; }
+        void setOnConnectCallback(void (*cb)()) { onConnect = cb; }
+        void setOnDisconnectCallback(void (*cb)()) { onDisconnect = cb; }
+        void setNoteOnCallback(void (*cb)(uint8_t, uint8_t, uint8_t, uint16_t)) { onNoteOn = cb; }
+        void setControlChangeCallback(void (*cb)(uint8_t, uint8_t, uint8_t, uint16_t)) { onControlChange = cb; }
+        void noteOn(uint8_t chan, uint8_t note, uint8_t vel);
+        void controlChange(uint8_t chan, uint8_t cc, uint8_t val);
+
+        bool running = false;
+        bool connected = false;
+        uint32_t messagesSent = 0;
+        void (*onConnect)() = nullptr;
+        void (*onDisconnect)() = nullptr;
+        void (*onNoteOn)(uint8_t, uint8_t, uint8_t, uint16_t) = nullptr;
+        void (*onControlChange)(uint8_t, uint8_t, uint8_t, uint16_t) = nullptr;
+};
+
+extern BLEMidiServerClass BLEMidiServer;
@@ -0,0 +1,49 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*  Host simulator stub - BLE pairing and bonding configuration.
+    The configuration is kept so the simulator only encrypts the link of a central that pairs if bonding is allowed.
+*/
+#pragma once
+
+#include <cstdint>
+
+typedef uint8_t esp_ble_auth_req_t;
+typedef uint8_t esp_ble_io_cap_t;
+
+#define ESP_LE_AUTH_NO_BOND 0x00
+#define ESP_LE_AUTH_BOND 0x01
+#define ESP_LE_AUTH_REQ_MITM (1 << 2)
+#define ESP_LE_AUTH_REQ_SC_ONLY (1 << 3)
+#define ESP_LE_AUTH_REQ_SC_BOND (ESP_LE_AUTH_BOND | ESP_LE_AUTH_REQ_SC_ONLY)
+#define ESP_IO_CAP_OUT 0
+#define ESP_IO_CAP_IO 1
+#define ESP_IO_CAP_IN 2
+#define ESP_IO_CAP_NONE 3
+#define ESP_BLE_ENC_KEY_MASK (1 << 0)
+#define ESP_BLE_ID_KEY_MASK (1 << 1)
+
+class BLESecurity {
+    public:
+        void setAuthenticationMode(esp_ble_auth_req_t req) { authReq = req; }
+        void setCapability(esp_ble_io_cap_t cap) { ioCap = cap; }
+        void setInitEncryptionKey(uint8_t key) { initKey = key; }
+
+        static esp_ble_auth_req_t authReq;
+        static esp_ble_io_cap_t ioCap;
+        static uint8_t initKey;
+};
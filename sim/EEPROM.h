@@ -0,0 +1,37 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Host simulator stub
+#pragma once
+
+#include "Arduino.h"
+
+class EEPROMClass {
+    public:
+        bool begin(size_t size) { m_size = size; return true; }
+        size_t readBytes(int addr, void* value, size_t len) { memcpy(value, m_data + addr, len); return len; }
+        size_t writeBytes(int addr, const void* value, size_t len) { memcpy(m_data + addr, value, len); return len; }
+        bool commit() { return true; }
+        void end() {}
+        uint8_t* getDataPtr() { return m_data; }
+
+    private:
+        uint8_t m_data[4096] = {};
+        size_t m_size = 0;
+};
+
+extern EEPROMClass EEPROM;
@@ -0,0 +1,249 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*  Host simulator stub - Stand-ins for the parts of the TTGO T-Watch library used by the firmware.
+    Drawing is done into RGB565 buffers so frames can be inspected on the host.
+*/
+#pragma once
+
+#include "Arduino.h"
+#include "sim.h"
+
+#define TFT_BLACK       0x0000
+#define TFT_NAVY        0x000F
+#define TFT_DARKGREEN   0x03E0
+#define TFT_DARKCYAN    0x03EF
+#define TFT_LIGHTGREY   0xD69A
+#define TFT_DARKGREY    0x7BEF
+#define TFT_BLUE        0x001F
+#define TFT_GREEN       0x07E0
+#define TFT_RED         0xF800
+#define TFT_YELLOW      0xFFE0
+#define TFT_WHITE       0xFFFF
+
+#define TL_DATUM 0
+#define TC_DATUM 1
+#define TR_DATUM 2
+#define ML_DATUM 3
+#define MC_DATUM 4
+#define MR_DATUM 5
+#define BL_DATUM 6
+#define BC_DATUM 7
+#define BR_DATUM 8
+
+#define AXP202_INT 35
+#define TOUCH_INT 38
+#define BMA423_INT1 39
+
+#define AXP202_PEK_LONGPRESS_IRQ (1ULL << 16)
+#define AXP202_PEK_SHORTPRESS_IRQ (1ULL << 17)
+#define AXP202_CHARGING_IRQ (1ULL << 11)
+#define AXP202_VBUS_REMOVED_IRQ (1ULL << 2)
+#define AXP202_VBUS_CONNECT_IRQ (1ULL << 3)
+
+#define DIRECTION_TOP_EDGE 0
+#define DIRECTION_BOTTOM_EDGE 1
+#define DIRECTION_LEFT_EDGE 2
+#define DIRECTION_RIGHT_EDGE 3
+#define DIRECTION_DISP_UP 4
+#define DIRECTION_DISP_DOWN 5
+
+#define BMA4_OUTPUT_DATA_RATE_100HZ 0x08
+#define BMA4_ACCEL_RANGE_2G 0
+#define BMA4_ACCEL_NORMAL_AVG4 2
+#define BMA4_CONTINUOUS_MODE 1
+
+#define BMA423_STEP_CNTR 0x01
+#define BMA423_ACTIVITY 0x02
+#define BMA423_TILT 0x04
+#define BMA423_WAKEUP 0x08
+#define BMA423_ANY_MOTION 0x20
+#define BMA423_NO_MOTION 0x40
+
+#define BMA423_STEP_CNTR_INT 0x02
+#define BMA423_ACTIVITY_INT 0x04
+#define BMA423_TILT_INT 0x08
+#define BMA423_WAKEUP_INT 0x20
+#define BMA423_ANY_NO_MOTION_INT 0x40
+
+typedef struct {
+    uint16_t bitmapOffset;
+    uint8_t width, height;
+    uint8_t xAdvance;
+    int8_t xOffset, yOffset;
+} GFXglyph;
+
+typedef struct {
+    uint8_t* bitmap;
+    GFXglyph* glyph;
+    uint16_t first, last;
+    uint8_t yAdvance;
+} GFXfont;
+
+// RGB565 canvas with the subset of the TFT_eSPI drawing API used by the firmware
+class TFT_eSPI {
+    public:
+        TFT_eSPI(int16_t w=240, int16_t h=240);
+        virtual ~TFT_eSPI();
+
+        void fillScreen(uint32_t colour) { fillRect(0, 0, m_width, m_height, colour); }
+        void drawPixel(int32_t x, int32_t y, uint32_t colour);
+        void drawFastHLine(int32_t x, int32_t y, int32_t w, uint32_t colour) { fillRect(x, y, w, 1, colour); }
+        void drawFastVLine(int32_t x, int32_t y, int32_t h, uint32_t colour) { fillRect(x, y, 1, h, colour); }
+        void drawLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint32_t colour);
+        void drawRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t colour);
+        void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t colour);
+        void fillRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t r, uint32_t colour);
+        void drawCircle(int32_t x, int32_t y, int32_t r, uint32_t colour);
+        void fillCircle(int32_t x, int32_t y, int32_t r, uint32_t colour);
+
+        void setFreeFont(const GFXfont* font) { m_font = font; }
+        void setTextColor(uint16_t colour) { m_textColour = colour; }
+        void setTextDatum(uint8_t datum) { m_datum = datum; }
+        uint8_t getTextDatum() { return m_datum; }
+        int16_t textWidth(const char* s);
+        int16_t drawString(const char* s, int32_t x, int32_t y, uint8_t font=1);
+        int16_t drawNumber(long n, int32_t x, int32_t y, uint8_t font=1);
+
+        // Panel transfer API
+        void setSwapBytes(bool swap) { m_swapBytes = swap; }
+        bool getSwapBytes() { return m_swapBytes; }
+        void startWrite() {}
+        void endWrite() {}
+        void pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t* data);
+        bool initDMA() { return true; }
+        void pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t* data, uint16_t* buffer=nullptr) { pushImage(x, y, w, h, data); }
+        bool dmaBusy() { return false; }
+        void dmaWait() {}
+
+        int16_t width() { return m_width; }
+        int16_t height() { return m_height; }
+        uint16_t readPixel(int32_t x, int32_t y);
+
+        uint32_t pixelsPushed = 0; // Simulator statistic: pixels written to panel
+
+    protected:
+        uint16_t* m_buffer = nullptr;
+        int16_t m_width, m_height;
+        const GFXfont* m_font = nullptr;
+        uint16_t m_textColour = TFT_WHITE;
+        uint8_t m_datum = TL_DATUM;
+        bool m_swapBytes = false;
+};
+
+class TFT_eSprite : public TFT_eSPI {
+    public:
+        TFT_eSprite(TFT_eSPI* tft) : TFT_eSPI(0, 0), m_tft(tft) {}
+        void* createSprite(int16_t w, int16_t h);
+        void deleteSprite();
+        bool created() { return m_buffer != nullptr; }
+        void fillSprite(uint32_t colour) { fillScreen(colour); }
+        void pushSprite(int32_t x, int32_t y);
+        void* getPointer() { return m_buffer; }
+
+    private:
+        TFT_eSPI* m_tft;
+};
+
+class AXP20X_Class {
+    public:
+        int enableIRQ(uint64_t mask, bool en) { return 0; }
+        int readIRQ() { return 0; }
+        void clearIRQ() { m_irq = 0; }
+        bool isPEKShortPressIRQ() { return m_irq & AXP202_PEK_SHORTPRESS_IRQ; }
+        bool isPEKLongPressIRQ() { return m_irq & AXP202_PEK_LONGPRESS_IRQ; }
+        bool isChargeing() { return charging; }
+        int getBattPercentage() { return battery; }
+
+        uint64_t m_irq = 0; // Pending simulated IRQ flags
+        bool charging = false;
+        int battery = 80;
+};
+
+typedef struct {
+    int16_t x, y, z;
+} Accel;
+
+typedef struct {
+    uint8_t odr, range, bandwidth, perf_mode;
+} Acfg;
+
+class BMA {
+    public:
+        bool accelConfig(Acfg& cfg) { simBootStep("accel"); return true; }
+        bool enableAccel(bool en=true) { return true; }
+        uint8_t direction() { return dir; }
+        bool getAccel(Accel& acc) { acc = sample; ++reads; return true; }
+        bool enableFeature(uint8_t feature, uint8_t enable) { return true; }
+        bool enableTiltInterrupt(bool en=true) { return true; }
+        bool enableWakeupInterrupt(bool en=true) { return true; }
+        bool enableAnyNoMotionInterrupt(bool en=true) { return true; }
+        bool readInterrupt() { m_irqStatus = irqStatus; irqStatus = 0; return true; }
+        bool isTilt() { return m_irqStatus & BMA423_TILT_INT; }
+        bool isDoubleClick() { return m_irqStatus & BMA423_WAKEUP_INT; }
+        bool isAnyNoMotion() { return m_irqStatus & BMA423_ANY_NO_MOTION_INT; }
+
+        uint8_t dir = DIRECTION_DISP_UP;
+        Accel sample = {0, 0, 1000};
+        uint16_t irqStatus = 0; // Pending simulated feature interrupt flags
+        uint32_t reads = 0; // Simulator statistic: sample reads over I2C
+
+    private:
+        uint16_t m_irqStatus = 0;
+};
+
+class PCF8563_Class {};
+
+class MOTOR_Class {
+    public:
+        void onec(int duration=80);
+        uint32_t pulses = 0; // Simulator statistic: haptic pulses
+};
+
+class FocalTech_Class {
+    public:
+        void enableINT() { triggerMode = true; }
+        void disableINT() { triggerMode = false; }
+        bool triggerMode = false; // True if interrupt pulses for each sample (otherwise held active whilst touched)
+};
+
+class TTGOClass {
+    public:
+        static TTGOClass* getWatch();
+        void begin() { simBootStep("watch"); }
+        void motor_begin() {}
+        void openBL() { backlight = true; }
+        void closeBL() { backlight = false; }
+        void setBrightness(uint8_t level) { brightness = level; }
+        void displaySleep() { panelAsleep = true; }
+        void displayWakeup() { panelAsleep = false; }
+        void touchToMonitor() { touchMonitor = true; }
+        bool getTouch(int16_t& x, int16_t& y);
+
+        TFT_eSPI* tft;
+        AXP20X_Class* power;
+        FocalTech_Class* touch;
+        BMA* bma;
+        MOTOR_Class* motor;
+
+        bool backlight = false;
+        uint8_t brightness = 255;
+        bool panelAsleep = false; // Simulated display panel sleep mode
+        bool touchMonitor = false; // Simulated touch controller monitor mode (leaves on touch)
+        bool touched = false; // Simulated touch state
+        int16_t touchX = 0, touchY = 0;
+};
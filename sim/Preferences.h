@@ -0,0 +1,48 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Host simulator stub
+#pragma once
+
+#include "Arduino.h"
+#include "sim.h"
+
+class Preferences {
+    public:
+        bool begin(const char* name, bool readOnly=false) { m_name = name; return true; }
+        void end() {}
+        size_t getBytesLength(const char* key) {
+            auto it = simNvs.find(m_name + "/" + key);
+            return it == simNvs.end() ? 0 : it->second.size();
+        }
+        size_t getBytes(const char* key, void* buf, size_t len) {
+            auto it = simNvs.find(m_name + "/" + key);
+            if (it == simNvs.end() || it->second.size() > len)
+                return 0;
+            memcpy(buf, it->second.data(), it->second.size());
+            return it->second.size();
+        }
+        size_t putBytes(const char* key, const void* value, size_t len) {
+            simNvs[m_name + "/" + key].assign((const uint8_t*)value, (const uint8_t*)value + len);
+            ++simNvsWrites;
+            return len;
+        }
+        bool remove(const char* key) { return simNvs.erase(m_name + "/" + key); }
+
+    private:
+        std::string m_name;
+};
@@ -0,0 +1,34 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*  Host simulator stub - ESP-IDF capability based heap allocator.
+*/
+#pragma once
+
+#include <cstdlib>
+
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+
+inline void* heap_caps_malloc(size_t size, uint32_t caps) { return malloc(size); }
+
+// Heap statistics are not modelled - report a fixed heap
+inline size_t heap_caps_get_free_size(uint32_t caps) { return 100000; }
+inline size_t heap_caps_get_minimum_free_size(uint32_t caps) { return 100000; }
+inline size_t heap_caps_get_largest_free_block(uint32_t caps) { return 100000; }
@@ -0,0 +1,115 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*  Host simulator stub - ESP-IDF mbedtls SHA-256 API.
+    Portable SHA-256 (FIPS 180-4) in place of the ESP32 hardware accelerated implementation, written for small size rather than speed.
+*/
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+typedef struct {
+    uint32_t state[8]; // Intermediate hash value
+    uint8_t buffer[64]; // Data waiting for a complete block
+    uint64_t total; // Quantity of bytes added
+} mbedtls_sha256_context;
+
+static inline uint32_t mbedtls_sha256_ror(uint32_t x, uint8_t n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+// Process one complete 64 byte block
+static inline void mbedtls_sha256_transform(mbedtls_sha256_context* ctx) {
+    static const uint32_t K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+    const uint8_t* b = ctx->buffer;
+    uint32_t w[64];
+    for (uint8_t i = 0; i < 16; ++i)
+        w[i] = (uint32_t)b[i * 4] << 24 | (uint32_t)b[i * 4 + 1] << 16 | (uint32_t)b[i * 4 + 2] << 8 | b[i * 4 + 3];
+    for (uint8_t i = 16; i < 64; ++i) {
+        uint32_t s0 = mbedtls_sha256_ror(w[i - 15], 7) ^ mbedtls_sha256_ror(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = mbedtls_sha256_ror(w[i - 2], 17) ^ mbedtls_sha256_ror(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t s[8];
+    memcpy(s, ctx->state, sizeof(s));
+    for (uint8_t i = 0; i < 64; ++i) {
+        uint32_t t1 = s[7] + (mbedtls_sha256_ror(s[4], 6) ^ mbedtls_sha256_ror(s[4], 11) ^ mbedtls_sha256_ror(s[4], 25)) + ((s[4] & s[5]) ^ (~s[4] & s[6])) + K[i] + w[i];
+        uint32_t t2 = (mbedtls_sha256_ror(s[0], 2) ^ mbedtls_sha256_ror(s[0], 13) ^ mbedtls_sha256_ror(s[0], 22)) + ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+        memmove(s + 1, s, 7 * sizeof(uint32_t));
+        s[4] += t1;
+        s[0] = t1 + t2;
+    }
+    for (uint8_t i = 0; i < 8; ++i)
+        ctx->state[i] += s[i];
+}
+
+static inline void mbedtls_sha256_init(mbedtls_sha256_context* ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+static inline void mbedtls_sha256_free(mbedtls_sha256_context* ctx) {
+}
+
+// is224 is not supported - SHA-256 only
+static inline int mbedtls_sha256_starts_ret(mbedtls_sha256_context* ctx, int is224) {
+    static const uint32_t INIT[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(ctx->state, INIT, sizeof(ctx->state));
+    ctx->total = 0;
+    return is224 ? -1 : 0;
+}
+
+static inline int mbedtls_sha256_update_ret(mbedtls_sha256_context* ctx, const unsigned char* input, size_t ilen) {
+    while (ilen) {
+        size_t used = ctx->total & 63;
+        size_t n = 64 - used < ilen ? 64 - used : ilen;
+        memcpy(ctx->buffer + used, input, n);
+        ctx->total += n;
+        input += n;
+        ilen -= n;
+        if ((ctx->total & 63) == 0)
+            mbedtls_sha256_transform(ctx);
+    }
+    return 0;
+}
+
+static inline int mbedtls_sha256_finish_ret(mbedtls_sha256_context* ctx, unsigned char output[32]) {
+    uint64_t bits = ctx->total * 8;
+    uint8_t pad = 0x80;
+    mbedtls_sha256_update_ret(ctx, &pad, 1);
+    pad = 0;
+    while ((ctx->total & 63) != 56)
+        mbedtls_sha256_update_ret(ctx, &pad, 1);
+    uint8_t len[8];
+    for (uint8_t i = 0; i < 8; ++i)
+        len[i] = bits >> (56 - 8 * i);
+    mbedtls_sha256_update_ret(ctx, len, 8);
+    for (uint8_t i = 0; i < 32; ++i)
+        output[i] = ctx->state[i / 4] >> (24 - 8 * (i % 4));
+    return 0;
+}
@@ -0,0 +1,877 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*  Host simulator - runs the firmware against stub hardware, driven by a script
+
+    Usage: program [script]   (reads script from stdin if not given)
+
+    Script commands, one per line (# starts a comment):
+        wait <ms>                       Advance simulated time
+        touch <x> <y>                   Finger down (or move) at screen coordinates
+        release                         Finger up
+        drag <x0> <y0> <x1> <y1> <ms>   Touch and move in a straight line over a period, then release
+        replay <file>                   Replay touch trace (as written by firmware after sending t over Serial) and report
+                                        touch to note-on latency. Samples marked "# bounce" are contact chatter, not touches.
+        button short|long               Press power button
+        gesture tilt|tap|up|down        Accelerometer detects wrist tilt, double tap or display turned face up / down
+        accel <x> <y> <z>               Set accelerometer reading (1g = 1024)
+        benchfilter [samples]           Time tilt filter on host and report ns per sample
+        noteon <chan> <note> <vel>      Receive MIDI note-on (channel 0..15)
+        noteoff <chan> <note>           Receive MIDI note-off (channel 0..15)
+        cc <chan> <cc> <val>            Receive MIDI control change (channel 0..15)
+        pc <chan> <program>             Receive MIDI program change (channel 0..15)
+        sysex <hex> ...                 Receive SysEx message with body given as hex bytes (F0 / F7 added)
+        start | stop                    Receive MIDI start or stop
+        spp <position>                  Receive MIDI song position pointer (16th notes)
+        clock <bpm> <ms> [interval]     Receive MIDI clock for a period, delivered in bursts each BLE connection interval (default 15ms)
+        benchclock <bpm> <interval> <jitter> [beats]
+                                        Feed clock tracker a clock stream delivered each connection interval (ms) with random
+                                        sender jitter (ms) and report beat timing error of tracker and of raw clock arrival
+        benchrx <interval> <jitter> [messages]
+                                        Feed receive timebase messages delivered each connection interval (ms) plus random
+                                        radio delay (ms) and report timing error of scheduled apply and of raw arrival
+        connect | disconnect            BLE MIDI central connects or disconnects
+        serial <text>                   Send characters to firmware over Serial
+        dump <file>                     Write display to binary PPM image
+        stats [label]                   Print and reset frame and MIDI counters
+        sent                            Print MIDI messages sent over BLE since last sent command
+        power                           Print CPU clock, light sleep and display power state
+        settings                        Print settings and settings record stored in flash
+        eeprom <hex> ...                Erase stored settings and write EEPROM as saved by firmware before versioned settings
+        oldprofile <index> <size>       Store profile record holding only the first size bytes of a profile, as older firmware
+        profiles                        Print size and validity of profile records stored in flash
+        reload                          Load settings and profiles from flash, as at boot
+        reboot                          Run setup() again, as after power on
+        bootcheck                       Check order of hardware initialisation at last boot: BLE advertising (if enabled) before
+                                        other hardware and display buffers only after setup. Simulator exits with failure if not.
+        ota <bytes> <mtu> <interval> <writes> [drop <n>] [cut <bytes>] [badhash] [disabled] [nopair]
+                                        Send a random firmware image with the firmware update protocol, as a paired client with the
+                                        given MTU sending the given quantity of data writes each connection interval (ms), then restart
+                                        into it and check it is confirmed. drop: lose every nth data write. cut: disconnect after
+                                        sending this many bytes, reconnect and resume. badhash: send wrong SHA-256 and check update is
+                                        refused. disabled: check update is refused because it is not allowed in settings. nopair:
+                                        connect without pairing and check writes are refused by the BLE stack. Reports time and
+                                        throughput. Simulator exits with failure if update does not behave.
+*/
+
+#include "Arduino.h"
+#include "LilyGoWatch.h"
+#include "BLEMidi.h"
+#include "main.h"
+#include "blemidi.h"
+#include "motion.h"
+#include "clock.h"
+#include "settings.h"
+#include "profile.h"
+#include "ota.h"
+#include "sha256.h"
+#include "BLESecurity.h"
+#include "EEPROM.h"
+#include "esp_ota_ops.h"
+#include "freertos/semphr.h"
+#include "sim.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#define SIM_INPUT_PERIOD 10 // Interval between touch samples (ms), as input task whilst touched
+#define SIM_RENDER_PERIOD 50 // Interval between display refreshes (ms), as render task
+#define SIM_TOUCH_REPORT_MS 12 // Touch controller sample period whilst touched (ms)
+
+void setup();
+void loop();
+extern volatile bool irq;
+extern bool standby;
+extern uint8_t settings[];
+extern uint8_t settingsSize;
+extern uint8_t bootDone;
+extern SemaphoreHandle_t uiMutex;
+extern SemaphoreHandle_t clockMutex;
+
+static TTGOClass* watch;
+static uint32_t frames = 0; // Quantity of display refreshes since last stats
+static uint32_t pixelsAtStats = 0; // Panel pixel count at last stats
+static size_t packetsAtStats = 0; // BLE MIDI packet count at last stats
+static uint32_t pulsesAtStats = 0; // Haptic pulse count at last stats
+static size_t packetsPrinted = 0; // BLE MIDI packet count at last sent command
+static uint32_t nextTouchReport = 0; // Time of next simulated touch controller sample whilst touched (ms)
+static bool failed = false; // True if a check failed - simulator exits with failure
+static bool touchReports = true; // False whilst replaying a touch trace, which holds the samples
+static bool linkEncrypted = false; // True whilst BLE central is paired and link is encrypted
+struct replay_note_t {
+    uint16_t timestamp; // BLE MIDI timestamp (ms, 13-bit)
+    uint8_t note;
+    bool on; // True for note-on, false for note-off
+};
+static std::vector<replay_note_t> replayNotes; // Note messages sent during replay
+
+// Get BLE MIDI characteristic, if BLE is running
+static BLECharacteristic* midiCharacteristic() {
+    if (!BLEDevice::getServer())
+        return nullptr;
+    return BLEDevice::getServer()->getServiceByUUID(BLE_MIDI_SERVICE_UUID)->getCharacteristic(BLE_MIDI_CHARACTERISTIC_UUID);
+}
+
+static void touchEvent();
+
+// Run firmware tasks for one millisecond of simulated time
+static void tick() {
+    static uint32_t nextInput = 0;
+    static uint32_t nextRender = 0;
+    simRunTimers();
+    processMidi();
+    processOta();
+    processStorage();
+    if (watch->touched && touchReports && watch->touch->triggerMode && millis() >= nextTouchReport)
+        touchEvent();
+    if (millis() >= nextInput) {
+        processInput();
+        nextInput = millis() + SIM_INPUT_PERIOD;
+    }
+    if (millis() >= nextRender) {
+        if (!standby)
+            ++frames;
+        processRender();
+        nextRender = millis() + SIM_RENDER_PERIOD;
+    }
+    simTimeUs += 1000;
+}
+
+static void advance(uint32_t ms) {
+    for (uint32_t i = 0; i < ms; ++i)
+        tick();
+}
+
+// Touch controller samples touch and signals interrupt which wakes input task
+static void touchEvent() {
+    nextTouchReport = millis() + SIM_TOUCH_REPORT_MS;
+    simInterrupt(TOUCH_INT);
+    processInput();
+}
+
+static void collectNote(uint8_t status, uint8_t data1, uint8_t data2, uint16_t timestamp) {
+    if ((status & 0xF0) == 0x90 || (status & 0xF0) == 0x80)
+        replayNotes.push_back({timestamp, data1, (status & 0xF0) == 0x90 && data2});
+}
+
+// Print average, median, 99th percentile and maximum of latencies (ms)
+static void printLatency(const char* label, std::vector<uint32_t>& latencies) {
+    std::sort(latencies.begin(), latencies.end());
+    uint64_t sum = 0;
+    for (uint32_t l : latencies)
+        sum += l;
+    size_t count = latencies.size();
+    printf(", %s avg %.1f ms p50 %u ms p99 %u ms max %u ms", label, count ? (double)sum / count : 0.0, count ? latencies[count / 2] : 0,
+        count ? latencies[(count * 99) / 100] : 0, count ? latencies.back() : 0);
+}
+
+/*  Replay a touch trace
+    Each touch is matched to the first note-on sent before the next touch and its lift (first untouched sample) to the note-off of that note.
+*/
+static void replay(const std::string& filename) {
+    std::ifstream file(filename);
+    if (!file) {
+        fprintf(stderr, "Cannot open %s\n", filename.c_str());
+        return;
+    }
+    BLECharacteristic* characteristic = midiCharacteristic();
+    size_t firstPacket = characteristic ? characteristic->notified.size() : 0;
+    std::vector<uint32_t> touches; // Time of each touch (ms)
+    std::vector<uint32_t> lifts; // Time of first untouched sample of each touch (ms)
+    uint32_t start = millis();
+    uint32_t firstUs = 0;
+    bool first = true;
+    std::string line;
+    touchReports = false;
+    while (std::getline(file, line)) {
+        std::istringstream args(line.substr(0, line.find('#')));
+        bool bounce = line.find("# bounce") != std::string::npos; // Contact chatter rather than a touch
+        uint32_t us;
+        std::string x;
+        if (!(args >> us >> x))
+            continue;
+        if (first)
+            firstUs = us;
+        first = false;
+        uint32_t t = start + (us - firstUs) / 1000;
+        if (t > millis())
+            advance(t - millis());
+        if (x == "-") {
+            if (watch->touched && lifts.size() < touches.size())
+                lifts.push_back(millis());
+            watch->touched = false;
+        } else {
+            if (!watch->touched && !bounce)
+                touches.push_back(millis());
+            watch->touchX = std::stoi(x);
+            args >> watch->touchY;
+            watch->touched = true;
+        }
+        touchEvent();
+    }
+    if (watch->touched && lifts.size() < touches.size())
+        lifts.push_back(millis());
+    watch->touched = false;
+    touchEvent();
+    advance(500);
+    touchReports = true;
+
+    replayNotes.clear();
+    BleMidiDecoder decoder;
+    for (size_t i = firstPacket; characteristic && i < characteristic->notified.size(); ++i)
+        decoder.decode(characteristic->notified[i].data(), characteristic->notified[i].size(), collectNote);
+    std::vector<uint32_t> times; // Time of each note message (ms)
+    uint32_t prev = start;
+    for (const replay_note_t& msg : replayNotes) {
+        prev += (msg.timestamp - prev) & 0x1FFF;
+        times.push_back(prev);
+    }
+    std::vector<uint32_t> onLatency, offLatency;
+    uint32_t missed = 0, noteOns = 0;
+    size_t n = 0;
+    for (const replay_note_t& msg : replayNotes)
+        noteOns += msg.on;
+    for (size_t i = 0; i < touches.size(); ++i) {
+        uint32_t end = i + 1 < touches.size() ? touches[i + 1] : UINT32_MAX;
+        while (n < times.size() && (times[n] < touches[i] || !replayNotes[n].on))
+            ++n;
+        if (n >= times.size() || times[n] >= end) {
+            ++missed;
+            continue;
+        }
+        onLatency.push_back(times[n] - touches[i]);
+        for (size_t off = n + 1; off < times.size(); ++off) {
+            if (!replayNotes[off].on && replayNotes[off].note == replayNotes[n].note) {
+                offLatency.push_back(times[off] - lifts[i]);
+                break;
+            }
+        }
+        ++n;
+    }
+    printf("replay %s: %zu touches, %u note-on, %u missed, %zu extra", filename.c_str(), touches.size(), noteOns, missed, noteOns - onLatency.size());
+    printLatency("touch>note-on", onLatency);
+    printLatency("lift>note-off", offLatency);
+    printf("\n");
+}
+
+static void dump(const std::string& filename) {
+    std::ofstream file(filename, std::ios::binary);
+    TFT_eSPI* tft = watch->tft;
+    file << "P6\n" << tft->width() << " " << tft->height() << "\n255\n";
+    for (int16_t y = 0; y < tft->height(); ++y) {
+        for (int16_t x = 0; x < tft->width(); ++x) {
+            uint16_t c = watch->backlight ? tft->readPixel(x, y) : 0;
+            char rgb[3] = {(char)((c >> 8) & 0xF8), (char)((c >> 3) & 0xFC), (char)((c << 3) & 0xF8)};
+            file.write(rgb, 3);
+        }
+    }
+}
+
+static void printMessage(uint8_t status, uint8_t data1, uint8_t data2, uint16_t timestamp) {
+    printf(" %02X %02X %02X", status, data1, data2);
+}
+
+// Print MIDI messages sent since last call
+static void printSent() {
+    BLECharacteristic* characteristic = midiCharacteristic();
+    BleMidiDecoder decoder;
+    printf("sent:");
+    for (; characteristic && packetsPrinted < characteristic->notified.size(); ++packetsPrinted) {
+        const std::vector<uint8_t>& packet = characteristic->notified[packetsPrinted];
+        decoder.decode(packet.data(), packet.size(), printMessage);
+    }
+    printf("\n");
+}
+
+/*  Check that setup() started BLE advertising before initialising the watch hardware, sprites and accelerometer, and that
+    sprite buffers were allocated only after tasks started so that the first frame does not delay advertising
+*/
+static void bootCheck() {
+    const std::vector<std::string>& log = simBootLog;
+    auto first = [&log](const char* step) {
+        return std::find(log.begin(), log.end(), step) - log.begin();
+    };
+    auto last = [&log](const char* step) {
+        auto it = std::find(log.rbegin(), log.rend(), step);
+        return it == log.rend() ? -1 : log.rend() - it - 1;
+    };
+    std::string error;
+    if (settings[0]) { // BLE enabled
+        if (first("advertise") == (long)log.size())
+            error = "BLE enabled but not advertising";
+        else if (first("watch") < first("advertise") || first("sprite") < first("advertise") || first("accel") < first("advertise"))
+            error = "hardware initialised before BLE advertising";
+    }
+    if (error.empty() && first("sprite") < last("task"))
+        error = "sprite allocated during setup";
+    printf("bootcheck:");
+    for (const std::string& step : log)
+        printf(" %s", step.c_str());
+    if (error.empty()) {
+        printf(" - ok\n");
+    } else {
+        printf(" - FAIL: %s\n", error.c_str());
+        failed = true;
+    }
+}
+
+// Run setup() again as after power on - RTOS objects do not exist until setup() creates them
+static void reboot() {
+    simBootLog.clear();
+    bootDone = 0;
+    uiMutex = clockMutex = nullptr;
+    BLESecurity::authReq = ESP_LE_AUTH_NO_BOND;
+    setup();
+    loop();
+}
+
+// Write to a GATT characteristic as a BLE central. Writes that need encryption are refused over an unencrypted link, as by Bluedroid.
+static void gattWrite(BLECharacteristic* characteristic, const uint8_t* data, uint16_t len) {
+    if ((characteristic->permissions & ESP_GATT_PERM_WRITE_ENCRYPTED) && !linkEncrypted)
+        return;
+    esp_ble_gatts_cb_param_t param = {};
+    param.write.handle = characteristic->getHandle();
+    param.write.len = len;
+    param.write.value = (uint8_t*)data;
+    BLEDevice::gattsHandler(ESP_GATTS_WRITE_EVT, 0, &param);
+}
+
+// Central connects and negotiates MTU. pair: Central pairs, which encrypts the link if firmware allows bonding.
+static void bleConnect(uint16_t mtu, bool pair) {
+    BLEMidiServer.connected = true;
+    linkEncrypted = pair && (BLESecurity::authReq & ESP_LE_AUTH_BOND);
+    if (BLEMidiServer.onConnect)
+        BLEMidiServer.onConnect();
+    esp_ble_gatts_cb_param_t param = {};
+    param.mtu.mtu = mtu;
+    BLEDevice::gattsHandler(ESP_GATTS_MTU_EVT, 0, &param);
+}
+
+static void bleDisconnect() {
+    BLEMidiServer.connected = false;
+    linkEncrypted = false;
+    if (BLEMidiServer.onDisconnect)
+        BLEMidiServer.onDisconnect();
+}
+
+/*  Stand-in firmware update client
+    Streams data writes without waiting for acknowledgement, spread over each connection interval, rewinding when firmware reports
+    missed data, then restarts the firmware as if booting the new image and checks the image is confirmed.
+*/
+static void otaUpdate(uint32_t size, uint16_t mtu, uint32_t interval, uint32_t writes, uint32_t drop, uint32_t cut, bool badHash, bool disabled, bool pair) {
+    BLEService* service = BLEDevice::getServer() ? BLEDevice::getServer()->getServiceByUUID(OTA_SERVICE_UUID) : nullptr;
+    if (!service) {
+        printf("ota: FAIL: firmware update service not running (BLE disabled?)\n");
+        failed = true;
+        return;
+    }
+    BLECharacteristic* control = service->getCharacteristic(OTA_CONTROL_UUID);
+    BLECharacteristic* data = service->getCharacteristic(OTA_DATA_UUID);
+    std::vector<uint8_t> image(size);
+    srand(size);
+    for (uint8_t& byte : image)
+        byte = rand();
+    image[0] = 0xE9; // Application image magic
+    uint8_t hash[SHA256_SIZE];
+    Sha256 sha;
+    sha.update(image.data(), size);
+    sha.finish(hash);
+    if (badHash)
+        hash[0] ^= 1;
+    uint8_t buf[OTA_DATA_HEADER + OTA_CHUNK_MAX];
+    size_t seen = control->notified.size();
+    // Wait up to timeout ms for next status notification
+    auto waitStatus = [&](ota_status_t& status, uint32_t timeout) {
+        for (uint32_t ms = 0; ms <= timeout; ++ms) {
+            while (seen < control->notified.size()) {
+                std::vector<uint8_t>& packet = control->notified[seen++];
+                if (otaParseStatus(packet.data(), packet.size(), status) && !status.rewind)
+                    return true;
+            }
+            tick();
+        }
+        return false;
+    };
+    auto begin = [&](ota_status_t& status) {
+        gattWrite(control, buf, otaPackBegin(buf, size, hash));
+        return waitStatus(status, 30000);
+    };
+
+    bleConnect(mtu, pair);
+    ota_status_t status = {};
+    uint32_t start = millis();
+    uint32_t next = 0; // Offset of next data write
+    uint32_t sent = 0; // Quantity of data writes sent
+    uint32_t rewinds = 0;
+    uint32_t resumed = 0; // Offset transfer resumed from after reconnecting
+    bool ok = begin(status);
+    uint16_t chunk = std::min<uint16_t>(status.maxChunk, mtu - 3 - OTA_DATA_HEADER);
+    while (ok && status.state == OTA_RECEIVING) {
+        // Stream data writes spread over each connection interval, following any rewind request
+        for (uint32_t ms = 0; ms < interval && next < size; ++ms) {
+            for (uint32_t i = writes * ms / interval; i < writes * (ms + 1) / interval && next < size; ++i) {
+                uint16_t len = std::min<uint32_t>(chunk, size - next);
+                if (!drop || ++sent % drop)
+                    gattWrite(data, buf, otaPackData(buf, next, image.data() + next, len));
+                next += len;
+            }
+            tick();
+            while (seen < control->notified.size()) {
+                std::vector<uint8_t>& packet = control->notified[seen++];
+                ota_status_t notified;
+                if (otaParseStatus(packet.data(), packet.size(), notified) && notified.rewind) {
+                    next = notified.offset;
+                    ++rewinds;
+                }
+            }
+        }
+        if (cut && next >= cut) {
+            cut = 0;
+            bleDisconnect();
+            advance(1000);
+            bleConnect(mtu, pair);
+            ok = begin(status);
+            next = resumed = status.offset;
+            continue;
+        }
+        if (next < size)
+            continue;
+        buf[0] = OTA_CMD_END;
+        gattWrite(control, buf, 1);
+        ok = waitStatus(status, 1000);
+        next = status.offset; // Resend anything missed
+    }
+    uint32_t ms = millis() - start;
+    bool match = simOtaImage == image;
+    printf("ota: %u bytes, MTU %u, %u writes per %ums: %s", size, mtu, writes, interval, ok ? OTA_STATE_NAMES[status.state] : "no reply");
+    if (status.state == OTA_FAILED)
+        printf(" (error %u)", status.error);
+    printf(" in %u.%us (%ukB/s), %u rewinds", ms / 1000, ms / 100 % 10, ms ? size / ms : 0, rewinds);
+    if (resumed)
+        printf(", resumed at %u", resumed);
+    printf(", image %s, boot %s", match ? "matches" : "differs", simOtaBootSet ? "updated" : "unchanged");
+    bool pass;
+    bool refused = badHash || disabled || !pair;
+    if (!pair)
+        pass = !ok && !match && !simOtaBootSet;
+    else if (refused)
+        pass = ok && status.state == OTA_FAILED && status.error == (disabled ? OTA_ERR_DISABLED : OTA_ERR_HASH) && !simOtaBootSet;
+    else
+        pass = ok && status.state == OTA_COMPLETE && match && simOtaBootSet && simRestarts;
+    printf(" - %s\n", pass ? "ok" : "FAIL");
+    bool restart = pass && !refused;
+    simOtaBootSet = false;
+    simRestarts = 0;
+    bleDisconnect();
+    if (restart) {
+        // Boot updated image, which must confirm itself so the bootloader does not roll back
+        simOtaState = ESP_OTA_IMG_PENDING_VERIFY;
+        reboot();
+        advance(500);
+        pass = simOtaState == ESP_OTA_IMG_VALID;
+        printf("ota: restarted into update - %s\n", pass ? "confirmed" : "FAIL: not confirmed, bootloader would roll back");
+    }
+    if (!pass)
+        failed = true;
+}
+
+static void stats(const std::string& label) {
+    uint32_t pixels = watch->tft->pixelsPushed - pixelsAtStats;
+    BLECharacteristic* characteristic = midiCharacteristic();
+    size_t packets = characteristic ? characteristic->notified.size() : 0;
+    printf("%-16s frames: %5u  pixels: %9u  pixels/frame: %7u  BLE packets: %5zu  haptic pulses: %3u\n", label.c_str(), frames, pixels, frames ? pixels / frames : 0, packets - packetsAtStats, watch->motor->pulses - pulsesAtStats);
+    frames = 0;
+    pixelsAtStats = watch->tft->pixelsPushed;
+    packetsAtStats = packets;
+    pulsesAtStats = watch->motor->pulses;
+}
+
+/*  Deliver MIDI messages to firmware as one BLE MIDI packet
+    times: Sender timestamp (ms) of each message, within 127ms of first - empty for current time
+*/
+static void receive(const std::vector<std::array<uint8_t, 3>>& messages, const std::vector<uint32_t>& times={}) {
+    uint8_t packet[BLE_MIDI_MAX_PACKET];
+    uint16_t size = 0;
+    uint32_t ms = times.empty() ? millis() : times[0];
+    packet[size++] = 0x80 | ((ms >> 7) & 0x3F);
+    for (size_t i = 0; i < messages.size(); ++i) {
+        auto& msg = messages[i];
+        if (!times.empty())
+            ms = times[i];
+        packet[size++] = 0x80 | (ms & 0x7F);
+        packet[size++] = msg[0];
+        for (uint8_t i = 0; i < midiDataLength(msg[0]); ++i)
+            packet[size++] = msg[1 + i];
+    }
+    onMidiPacket(packet, size);
+}
+
+static void receive(uint8_t status, uint8_t data1=0, uint8_t data2=0) {
+    receive({{status, data1, data2}});
+}
+
+// Deliver a SysEx message to firmware in one BLE MIDI packet
+static void receiveSysex(const std::vector<uint8_t>& body) {
+    std::vector<uint8_t> packet;
+    uint16_t ms = millis();
+    packet.push_back(0x80 | ((ms >> 7) & 0x3F));
+    packet.push_back(0x80 | (ms & 0x7F));
+    packet.push_back(0xF0);
+    packet.insert(packet.end(), body.begin(), body.end());
+    packet.push_back(0x80 | (ms & 0x7F));
+    packet.push_back(0xF7);
+    onMidiPacket(packet.data(), packet.size());
+}
+
+// Print mean and spread around the mean of timing errors (us)
+static void report(const char* name, const std::vector<int64_t>& errors) {
+    double mean = 0, rms = 0, worst = 0;
+    for (int64_t e : errors)
+        mean += e;
+    mean /= errors.size();
+    for (int64_t e : errors) {
+        double d = e - mean;
+        rms += d * d;
+        if (d > worst || -d > worst)
+            worst = d < 0 ? -d : d;
+    }
+    rms = sqrt(rms / errors.size());
+    printf("  %-8s latency %7.0fus  jitter rms %6.0fus  max %6.0fus\n", name, mean, rms, worst);
+}
+
+// Send MIDI clock for a period, batching clocks due within each BLE connection interval into one packet
+static void clock(uint32_t bpm, uint32_t ms, uint32_t interval) {
+    uint64_t period = 60000000ULL / (bpm * 24); // us
+    uint64_t start = simTimeUs;
+    uint64_t next = start;
+    while (simTimeUs < start + ms * 1000ULL) {
+        std::vector<std::array<uint8_t, 3>> clocks;
+        std::vector<uint32_t> times;
+        for (; next <= simTimeUs; next += period) {
+            clocks.push_back({0xF8, 0, 0});
+            times.push_back(next / 1000);
+        }
+        if (!clocks.empty())
+            receive(clocks, times);
+        advance(interval);
+    }
+}
+
+/*  Measure beat timing of clock tracker against an ideal clock
+    Sender jitters each clock by up to jitter ms then it waits for the next connection interval.
+    Tracker prediction of each beat, made from clocks received before the beat, is compared with the ideal beat time.
+    Result is spread around the mean (constant latency does not matter to a metronome).
+*/
+static void benchClock(uint32_t bpm, uint32_t interval, uint32_t jitter, uint32_t beats) {
+    ClockPll pll;
+    uint64_t period = 60000000ULL / (bpm * 24);
+    uint32_t seed = 1;
+    std::vector<int64_t> predicted, raw;
+    uint64_t lastArrival = 0;
+    pll.start();
+    for (uint32_t n = 0; n < beats * CLOCK_PPQN; ++n) {
+        uint64_t ideal = 1000000 + n * period;
+        seed = seed * 1103515245 + 12345;
+        uint64_t sent = ideal + (jitter ? (seed >> 8) % (jitter * 1000) : 0);
+        uint64_t arrival = (sent / (interval * 1000) + 1) * interval * 1000;
+        if (arrival < lastArrival)
+            arrival = lastArrival;
+        lastArrival = arrival;
+        if (n % CLOCK_PPQN == 0 && n >= 4 * CLOCK_PPQN) {
+            // Beat predicted before its own clock arrives
+            predicted.push_back((int64_t)pll.tickTime(n) - (int64_t)ideal);
+            raw.push_back((int64_t)arrival - (int64_t)ideal);
+        }
+        pll.tick(arrival);
+    }
+    printf("clock %u bpm, interval %ums, jitter %ums, %zu beats: tracked %u.%u bpm\n", bpm, interval, jitter, predicted.size(), pll.bpm() / 10, pll.bpm() % 10);
+    report("tracker", predicted);
+    report("raw", raw);
+}
+
+/*  Measure timing of messages applied via sender timestamps against applying them on arrival
+    Sender sends a message at random intervals (about 20 per second) with its clock offset from and drifting (50ppm) against the local clock.
+    Each message waits for the next connection interval then a random radio delay of up to jitter ms.
+    First 20 messages are not reported whilst timebase settles.
+*/
+static void benchRx(uint32_t interval, uint32_t jitter, uint32_t messages) {
+    BleMidiTimebase timebase;
+    uint32_t seed = 1;
+    uint64_t sent = 1000000;
+    uint64_t lastArrival = 0;
+    uint32_t late = 0;
+    std::vector<int64_t> applied, raw;
+    for (uint32_t n = 0; n < messages; ++n) {
+        seed = seed * 1103515245 + 12345;
+        sent += 1000 + (seed >> 8) % 90000;
+        seed = seed * 1103515245 + 12345;
+        uint64_t arrival = (sent / (interval * 1000) + 1) * interval * 1000 + (jitter ? (seed >> 8) % (jitter * 1000) : 0);
+        if (arrival < lastArrival)
+            arrival = lastArrival;
+        lastArrival = arrival;
+        uint16_t timestamp = (sent + sent / 20000 + 7000000) / 1000 & 0x1FFF; // Sender clock
+        int64_t due = timebase.map(timestamp, arrival) + BLE_MIDI_RX_LATENCY;
+        int64_t error = (uint32_t)due - (uint32_t)sent; // Local clock wraps at 32 bits
+        if (error < (int64_t)(arrival - sent)) {
+            error = arrival - sent; // Applied on arrival
+            ++late;
+        }
+        if (n < 20)
+            continue; // Timebase still finding least delayed message
+        applied.push_back(error);
+        raw.push_back(arrival - sent);
+    }
+    printf("rx interval %ums, jitter %ums, %u messages, latency %uus: %u late\n", interval, jitter, messages, BLE_MIDI_RX_LATENCY, late);
+    report("scheduled", applied);
+    report("arrival", raw);
+}
+
+// Time one euro filter over a synthetic noisy wrist movement
+static void benchFilter(uint32_t samples) {
+    OneEuroFilter filter;
+    filter.begin(100, 256, 66);
+    std::vector<int16_t> input(samples);
+    uint32_t seed = 1;
+    for (uint32_t i = 0; i < samples; ++i) {
+        seed = seed * 1103515245 + 12345;
+        input[i] = ((i / 200) % 2 ? 800 : -800) + (int16_t)((seed >> 16) % 41) - 20;
+    }
+    volatile int32_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < samples; ++i)
+        sink = filter.update(input[i]);
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    printf("one euro filter: %u samples, %.1f ns/sample (last output %d)\n", samples, ns / samples, (int)sink);
+}
+
+static void run(std::istream& script) {
+    std::string line;
+    while (std::getline(script, line)) {
+        std::istringstream args(line.substr(0, line.find('#')));
+        std::string cmd;
+        if (!(args >> cmd))
+            continue;
+        if (cmd == "wait") {
+            uint32_t ms = 0;
+            args >> ms;
+            advance(ms);
+        } else if (cmd == "touch") {
+            args >> watch->touchX >> watch->touchY;
+            watch->touched = true;
+            touchEvent();
+        } else if (cmd == "replay") {
+            std::string filename;
+            args >> filename;
+            replay(filename);
+        } else if (cmd == "release") {
+            watch->touched = false;
+            touchEvent();
+        } else if (cmd == "drag") {
+            int x0, y0, x1, y1, ms;
+            args >> x0 >> y0 >> x1 >> y1 >> ms;
+            watch->touched = true;
+            for (int t = 0; t <= ms; t += SIM_INPUT_PERIOD) {
+                watch->touchX = x0 + (x1 - x0) * t / (ms ? ms : 1);
+                watch->touchY = y0 + (y1 - y0) * t / (ms ? ms : 1);
+                touchEvent();
+                advance(SIM_INPUT_PERIOD);
+            }
+            watch->touched = false;
+            touchEvent();
+        } else if (cmd == "button") {
+            std::string type;
+            args >> type;
+            watch->power->m_irq = (type == "long") ? AXP202_PEK_LONGPRESS_IRQ : AXP202_PEK_SHORTPRESS_IRQ;
+            irq = true;
+            processInput();
+        } else if (cmd == "gesture") {
+            std::string type;
+            args >> type;
+            if (type == "tilt")
+                watch->bma->irqStatus = BMA423_TILT_INT;
+            else if (type == "tap")
+                watch->bma->irqStatus = BMA423_WAKEUP_INT;
+            else {
+                watch->bma->dir = (type == "down") ? DIRECTION_DISP_DOWN : DIRECTION_DISP_UP;
+                watch->bma->irqStatus = BMA423_ANY_NO_MOTION_INT;
+            }
+            simInterrupt(BMA423_INT1);
+            processInput();
+        } else if (cmd == "accel") {
+            args >> watch->bma->sample.x >> watch->bma->sample.y >> watch->bma->sample.z;
+        } else if (cmd == "benchfilter") {
+            uint32_t samples = 1000000;
+            args >> samples;
+            benchFilter(samples);
+        } else if (cmd == "noteon") {
+            int chan, note, vel;
+            args >> chan >> note >> vel;
+            receive(0x90 | chan, note, vel);
+        } else if (cmd == "noteoff") {
+            int chan, note;
+            args >> chan >> note;
+            receive(0x80 | chan, note, 0);
+        } else if (cmd == "pc") {
+            int chan, program;
+            args >> chan >> program;
+            receive(0xC0 | chan, program);
+        } else if (cmd == "sysex") {
+            std::vector<uint8_t> body;
+            std::string byte;
+            while (args >> byte)
+                body.push_back(std::stoul(byte, nullptr, 16) & 0x7F);
+            receiveSysex(body);
+        } else if (cmd == "spp") {
+            int position;
+            args >> position;
+            receive(0xF2, position & 0x7F, position >> 7);
+        } else if (cmd == "cc") {
+            int chan, cc, val;
+            args >> chan >> cc >> val;
+            receive(0xB0 | chan, cc, val);
+        } else if (cmd == "start") {
+            receive(0xFA);
+        } else if (cmd == "stop") {
+            receive(0xFC);
+        } else if (cmd == "clock") {
+            uint32_t bpm = 120, ms = 0, interval = 15;
+            args >> bpm >> ms >> interval;
+            clock(bpm, ms, interval);
+        } else if (cmd == "benchclock") {
+            uint32_t bpm = 120, interval = 15, jitter = 0, beats = 200;
+            args >> bpm >> interval >> jitter >> beats;
+            benchClock(bpm, interval, jitter, beats);
+        } else if (cmd == "benchrx") {
+            uint32_t interval = 15, jitter = 0, messages = 10000;
+            args >> interval >> jitter >> messages;
+            benchRx(interval, jitter, messages);
+        } else if (cmd == "connect") {
+            BLEMidiServer.connected = true;
+            if (BLEMidiServer.onConnect)
+                BLEMidiServer.onConnect();
+        } else if (cmd == "disconnect") {
+            bleDisconnect();
+        } else if (cmd == "ota") {
+            uint32_t size = 0, mtu = 247, interval = 15, writes = 4, drop = 0, cut = 0;
+            bool badHash = false, disabled = false, pair = true;
+            args >> size >> mtu >> interval >> writes;
+            std::string option;
+            while (args >> option) {
+                if (option == "drop")
+                    args >> drop;
+                else if (option == "cut")
+                    args >> cut;
+                else if (option == "badhash")
+                    badHash = true;
+                else if (option == "disabled")
+                    disabled = true;
+                else if (option == "nopair")
+                    pair = false;
+            }
+            otaUpdate(size, mtu, interval, writes, drop, cut, badHash, disabled, pair);
+        } else if (cmd == "serial") {
+            std::string text;
+            std::getline(args >> std::ws, text);
+            simSerialInput += text;
+        } else if (cmd == "dump") {
+            std::string filename;
+            args >> filename;
+            dump(filename);
+        } else if (cmd == "power") {
+            printf("power: cpu %dMHz, light sleep %s, wake pins %u, backlight %s, brightness %u, panel %s, touch %s\n", simCpuMhz, simLightSleep ? "on" : "off", simWakePins,
+                watch->backlight ? "on" : "off", watch->brightness, watch->panelAsleep ? "asleep" : "awake", watch->touchMonitor ? "monitor" : "active");
+        } else if (cmd == "settings") {
+            printf("settings:");
+            for (uint8_t i = 0; i < settingsSize; ++i)
+                printf(" %u", settings[i]);
+            auto it = simNvs.find("riband/settings");
+            settings_record_t record;
+            if (it == simNvs.end() || it->second.size() != sizeof(record)) {
+                printf("  stored: none");
+            } else {
+                memcpy(&record, it->second.data(), sizeof(record));
+                printf("  stored: version %u, %u values, %s, %u flash writes", record.version, record.count, record.valid() ? "valid" : "corrupt", simNvsWrites);
+            }
+            printf("\n");
+        } else if (cmd == "eeprom") {
+            simNvs.erase("riband/settings");
+            uint32_t byte;
+            for (uint16_t i = 0; args >> std::hex >> byte; ++i)
+                EEPROM.getDataPtr()[i] = byte;
+        } else if (cmd == "oldprofile") {
+            uint32_t index = 0, size = 0;
+            args >> index >> size;
+            profile_record_t record;
+            record.pack(1, DEFAULT_PROFILE);
+            record.size = std::min<uint32_t>(size, sizeof(profile_t));
+            record.crc = record.calcCrc();
+            uint8_t* p = (uint8_t*)&record;
+            simNvs["riband/profile" + std::to_string(index)].assign(p, p + record.length());
+        } else if (cmd == "profiles") {
+            printf("profiles:");
+            for (uint8_t i = 0; i < PROFILE_COUNT; ++i) {
+                auto it = simNvs.find("riband/profile" + std::to_string(i));
+                if (it == simNvs.end()) {
+                    printf(" -");
+                    continue;
+                }
+                profile_record_t record;
+                memcpy(&record, it->second.data(), std::min(it->second.size(), sizeof(record)));
+                printf(" %u%s", record.size, record.valid(it->second.size()) ? "" : "(corrupt)");
+            }
+            printf("  (bytes stored, full profile %zu)\n", sizeof(profile_t));
+        } else if (cmd == "reboot") {
+            reboot();
+        } else if (cmd == "bootcheck") {
+            bootCheck();
+        } else if (cmd == "reload") {
+            loadStorage();
+            bindMidiHandlers();
+        } else if (cmd == "sent") {
+            printSent();
+        } else if (cmd == "stats") {
+            std::string label;
+            std::getline(args >> std::ws, label);
+            stats(label);
+        } else {
+            fprintf(stderr, "Unknown command: %s\n", cmd.c_str());
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    watch = TTGOClass::getWatch();
+    setup();
+    loop();
+    if (argc > 1) {
+        std::ifstream script(argv[1]);
+        if (!script) {
+            fprintf(stderr, "Cannot open %s\n", argv[1]);
+            return 1;
+        }
+        run(script);
+    } else {
+        run(std::cin);
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,51 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Host simulator - shared simulator state
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+extern uint64_t simTimeUs; // Simulated time since boot (us)
+extern std::string simSerialInput; // Characters waiting to be read from Serial
+
+// Call the interrupt handler attached to a GPIO, if any
+void simInterrupt(uint8_t pin);
+
+// Fire any esp_timer that is due
+void simRunTimers();
+
+extern int simCpuMhz; // Maximum CPU clock set by firmware
+extern bool simLightSleep; // True if automatic light sleep is enabled
+extern uint8_t simWakePins; // Quantity of GPIO enabled to wake from light sleep
+
+extern std::map<std::string, std::vector<uint8_t>> simNvs; // Contents of NVS flash by "namespace/key"
+extern uint32_t simNvsWrites; // Quantity of NVS writes
+
+extern std::vector<std::string> simBootLog; // Hardware initialisation steps in the order firmware performed them
+
+// Record a hardware initialisation step, e.g. "advertise", "watch", "sprite"
+void simBootStep(const char* step);
+
+extern std::vector<uint8_t> simOtaImage; // Contents of update partition written by firmware
+extern bool simOtaBootSet; // True if firmware selected update partition to boot
+extern int simOtaState; // Image state (esp_ota_img_states_t) of running firmware
+extern uint32_t simRestarts; // Quantity of esp_restart() calls
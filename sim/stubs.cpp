@@ -0,0 +1,463 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Host simulator - implementation of hardware stubs
+
+#include "Arduino.h"
+#include "LilyGoWatch.h"
+#include "BLEMidi.h"
+#include "BLESecurity.h"
+#include "EEPROM.h"
+#include "freertos/semphr.h"
+#include "esp_freertos_hooks.h"
+#include "esp_timer.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_ota_ops.h"
+#include "driver/gpio.h"
+#include "sim.h"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+HardwareSerial Serial;
+BLEMidiServerClass BLEMidiServer;
+BLEServer* BLEDevice::m_pServer = nullptr;
+void (*BLEDevice::gapHandler)(esp_gap_ble_cb_event_t, esp_ble_gap_cb_param_t*) = nullptr;
+void (*BLEDevice::gattsHandler)(esp_gatts_cb_event_t, esp_gatt_if_t, esp_ble_gatts_cb_param_t*) = nullptr;
+esp_ble_auth_req_t BLESecurity::authReq = ESP_LE_AUTH_NO_BOND;
+esp_ble_io_cap_t BLESecurity::ioCap = ESP_IO_CAP_NONE;
+uint8_t BLESecurity::initKey = 0;
+EEPROMClass EEPROM;
+
+uint64_t simTimeUs = 0;
+std::string simSerialInput;
+
+uint32_t millis() { return simTimeUs / 1000; }
+uint32_t micros() { return simTimeUs; }
+void delay(uint32_t ms) { simTimeUs += ms * 1000ULL; }
+void pinMode(uint8_t pin, uint8_t mode) {}
+int digitalRead(uint8_t pin) { return HIGH; }
+static void (*isrs[40])() = {}; // Interrupt handlers indexed by GPIO
+void attachInterrupt(uint8_t pin, void (*isr)(), int mode) {
+    if (pin < 40)
+        isrs[pin] = isr;
+}
+
+int simCpuMhz = 240;
+bool simLightSleep = false;
+uint8_t simWakePins = 0;
+std::map<std::string, std::vector<uint8_t>> simNvs;
+uint32_t simNvsWrites = 0;
+std::vector<std::string> simBootLog;
+
+void simBootStep(const char* step) {
+    simBootLog.push_back(step);
+}
+
+std::vector<uint8_t> simOtaImage;
+bool simOtaBootSet = false;
+int simOtaState = ESP_OTA_IMG_VALID;
+uint32_t simRestarts = 0;
+static const esp_partition_t otaPartitions[] = {{0x10000, 0x640000, "app0"}, {0x650000, 0x640000, "app1"}}; // As default 16MB partition table
+static esp_ota_handle_t otaOpenHandle = 0; // Handle of update being written, 0 if none
+static esp_ota_handle_t otaLastHandle = 0;
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from) {
+    return &otaPartitions[1];
+}
+
+const esp_partition_t* esp_ota_get_running_partition() {
+    return &otaPartitions[0];
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t* partition, size_t image_size, esp_ota_handle_t* out_handle) {
+    if (image_size > partition->size)
+        return ESP_ERR_INVALID_ARG;
+    simOtaImage.clear();
+    simOtaBootSet = false;
+    simTimeUs += (image_size + 0xFFFF) / 0x10000 * 150000ULL; // Erase takes about 150ms per 64kB block
+    *out_handle = otaOpenHandle = ++otaLastHandle;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size) {
+    if (!handle || handle != otaOpenHandle)
+        return ESP_ERR_INVALID_ARG;
+    const uint8_t* p = (const uint8_t*)data;
+    if (simOtaImage.empty() && size && p[0] != 0xE9)
+        return ESP_ERR_OTA_VALIDATE_FAILED; // Not an application image
+    simOtaImage.insert(simOtaImage.end(), p, p + size);
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle) {
+    if (!handle || handle != otaOpenHandle)
+        return ESP_ERR_INVALID_ARG;
+    otaOpenHandle = 0;
+    return simOtaImage.empty() || simOtaImage[0] != 0xE9 ? ESP_ERR_OTA_VALIDATE_FAILED : ESP_OK;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle) {
+    if (!handle || handle != otaOpenHandle)
+        return ESP_ERR_INVALID_ARG;
+    otaOpenHandle = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition) {
+    simOtaBootSet = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t* partition, esp_ota_img_states_t* state) {
+    *state = (esp_ota_img_states_t)simOtaState;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback() {
+    simOtaState = ESP_OTA_IMG_VALID;
+    return ESP_OK;
+}
+
+void esp_restart() {
+    ++simRestarts;
+}
+
+int esp_ble_gap_update_conn_params(esp_ble_conn_update_params_t* params) {
+    if (BLEDevice::gapHandler) {
+        esp_ble_gap_cb_param_t param = {};
+        param.update_conn_params.conn_int = params->max_int;
+        BLEDevice::gapHandler(ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT, &param);
+    }
+    return 0;
+}
+
+bool setCpuFrequencyMhz(uint32_t mhz) {
+    simCpuMhz = mhz;
+    return true;
+}
+
+uint32_t getCpuFrequencyMhz() { return simCpuMhz; }
+
+esp_err_t esp_pm_configure(const void* config) {
+    const esp_pm_config_esp32_t* pm = (const esp_pm_config_esp32_t*)config;
+    simCpuMhz = pm->max_freq_mhz;
+    simLightSleep = pm->light_sleep_enable;
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_gpio_wakeup() { return ESP_OK; }
+
+esp_err_t gpio_wakeup_enable(gpio_num_t gpio_num, gpio_int_type_t intr_type) {
+    ++simWakePins;
+    return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_disable(gpio_num_t gpio_num) {
+    --simWakePins;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type) { return ESP_OK; }
+
+void simInterrupt(uint8_t pin) {
+    if (pin < 40 && isrs[pin])
+        isrs[pin]();
+}
+int HardwareSerial::available() { return simSerialInput.size(); }
+
+int HardwareSerial::read() {
+    if (simSerialInput.empty())
+        return -1;
+    int c = (uint8_t)simSerialInput[0];
+    simSerialInput.erase(0, 1);
+    return c;
+}
+
+static std::vector<esp_timer*> timers; // Timers created by firmware
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle) {
+    *handle = new esp_timer{args->callback, args->arg, 0, false};
+    timers.push_back(*handle);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    if (timer->armed)
+        return ESP_ERR_INVALID_STATE;
+    timer->due = simTimeUs + timeout_us;
+    timer->armed = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (!timer->armed)
+        return ESP_ERR_INVALID_STATE;
+    timer->armed = false;
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time() {
+    return simTimeUs;
+}
+
+void simRunTimers() {
+    for (esp_timer* timer : timers) {
+        if (timer->armed && timer->due <= simTimeUs) {
+            timer->armed = false;
+            timer->callback(timer->arg);
+        }
+    }
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stack, void* param, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+    simBootStep("task");
+    if (handle)
+        *handle = (TaskHandle_t)fn;
+    return pdPASS;
+}
+TickType_t xTaskGetTickCount() { return millis(); }
+void vTaskDelay(TickType_t ticks) {}
+void vTaskDelayUntil(TickType_t* previous, TickType_t increment) { *previous += increment; }
+void vTaskDelete(TaskHandle_t task) {}
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t timeout) { return 0; }
+BaseType_t xTaskNotifyGive(TaskHandle_t task) { return pdPASS; }
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* woken) {}
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) { return 0; }
+SemaphoreHandle_t xSemaphoreCreateMutex() { static int mutex; return &mutex; }
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() { static int mutex; return &mutex; }
+// FreeRTOS asserts if a semaphore is used before it is created
+static BaseType_t checkSemaphore(SemaphoreHandle_t sem, const char* fn) {
+    if (!sem) {
+        fprintf(stderr, "%s: semaphore used before it was created\n", fn);
+        abort();
+    }
+    return pdTRUE;
+}
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t timeout) { return checkSemaphore(sem, __func__); }
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) { return checkSemaphore(sem, __func__); }
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t timeout) { return checkSemaphore(sem, __func__); }
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem) { return checkSemaphore(sem, __func__); }
+int esp_register_freertos_idle_hook_for_cpu(esp_freertos_idle_cb_t cb, UBaseType_t cpu) { return 0; }
+
+static inline uint16_t swap16(uint16_t c) { return (c >> 8) | (c << 8); }
+
+TFT_eSPI::TFT_eSPI(int16_t w, int16_t h) : m_width(w), m_height(h) {
+    if (w && h)
+        m_buffer = (uint16_t*)calloc(w * h, 2);
+}
+
+TFT_eSPI::~TFT_eSPI() {
+    free(m_buffer);
+}
+
+void TFT_eSPI::drawPixel(int32_t x, int32_t y, uint32_t colour) {
+    if (!m_buffer || x < 0 || y < 0 || x >= m_width || y >= m_height)
+        return;
+    m_buffer[y * m_width + x] = swap16(colour);
+}
+
+void TFT_eSPI::fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t colour) {
+    for (int32_t j = y; j < y + h; ++j)
+        for (int32_t i = x; i < x + w; ++i)
+            drawPixel(i, j, colour);
+}
+
+void TFT_eSPI::drawRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t colour) {
+    drawFastHLine(x, y, w, colour);
+    drawFastHLine(x, y + h - 1, w, colour);
+    drawFastVLine(x, y, h, colour);
+    drawFastVLine(x + w - 1, y, h, colour);
+}
+
+void TFT_eSPI::drawLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint32_t colour) {
+    int32_t dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+    int32_t dy = -abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+    int32_t err = dx + dy;
+    while (true) {
+        drawPixel(x0, y0, colour);
+        if (x0 == x1 && y0 == y1)
+            break;
+        int32_t e2 = 2 * err;
+        if (e2 >= dy) {
+            err += dy;
+            x0 += sx;
+        }
+        if (e2 <= dx) {
+            err += dx;
+            y0 += sy;
+        }
+    }
+}
+
+void TFT_eSPI::fillRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t r, uint32_t colour) {
+    for (int32_t j = 0; j < h; ++j) {
+        int32_t inset = 0;
+        int32_t d = j < r ? r - j : (j >= h - r ? j - (h - r) + 1 : 0);
+        while (inset < r && (r - inset) * (r - inset) + d * d > r * r && d)
+            ++inset;
+        fillRect(x + inset, y + j, w - 2 * inset, 1, colour);
+    }
+}
+
+void TFT_eSPI::drawCircle(int32_t x0, int32_t y0, int32_t r, uint32_t colour) {
+    int32_t x = r, y = 0, err = 1 - r;
+    while (x >= y) {
+        drawPixel(x0 + x, y0 + y, colour); drawPixel(x0 + y, y0 + x, colour);
+        drawPixel(x0 - y, y0 + x, colour); drawPixel(x0 - x, y0 + y, colour);
+        drawPixel(x0 - x, y0 - y, colour); drawPixel(x0 - y, y0 - x, colour);
+        drawPixel(x0 + y, y0 - x, colour); drawPixel(x0 + x, y0 - y, colour);
+        ++y;
+        if (err < 0) {
+            err += 2 * y + 1;
+        } else {
+            --x;
+            err += 2 * (y - x) + 1;
+        }
+    }
+}
+
+void TFT_eSPI::fillCircle(int32_t x0, int32_t y0, int32_t r, uint32_t colour) {
+    for (int32_t j = -r; j <= r; ++j)
+        for (int32_t i = -r; i <= r; ++i)
+            if (i * i + j * j <= r * r)
+                drawPixel(x0 + i, y0 + j, colour);
+}
+
+int16_t TFT_eSPI::textWidth(const char* s) {
+    if (!m_font)
+        return strlen(s) * 6;
+    int16_t w = 0;
+    for (; *s; ++s) {
+        uint8_t c = *s;
+        if (c < m_font->first || c > m_font->last)
+            continue;
+        w += m_font->glyph[c - m_font->first].xAdvance;
+    }
+    return w;
+}
+
+int16_t TFT_eSPI::drawString(const char* s, int32_t x, int32_t y, uint8_t font) {
+    int16_t w = textWidth(s);
+    int16_t h = m_font ? m_font->yAdvance : 8;
+    switch (m_datum % 3) {
+        case 1: x -= w / 2; break;
+        case 2: x -= w; break;
+    }
+    // Translate datum to baseline
+    switch (m_datum / 3) {
+        case 0: y += h * 2 / 3; break;
+        case 1: y += h / 3; break;
+    }
+    if (!m_font) {
+        fillRect(x, y - 7, w, 7, m_textColour);
+        return w;
+    }
+    for (; *s; ++s) {
+        uint8_t c = *s;
+        if (c < m_font->first || c > m_font->last)
+            continue;
+        const GFXglyph* g = &m_font->glyph[c - m_font->first];
+        const uint8_t* bitmap = m_font->bitmap + g->bitmapOffset;
+        uint16_t bit = 0;
+        for (uint8_t j = 0; j < g->height; ++j)
+            for (uint8_t i = 0; i < g->width; ++i, ++bit)
+                if (bitmap[bit >> 3] & (0x80 >> (bit & 7)))
+                    drawPixel(x + g->xOffset + i, y + g->yOffset + j, m_textColour);
+        x += g->xAdvance;
+    }
+    return w;
+}
+
+int16_t TFT_eSPI::drawNumber(long n, int32_t x, int32_t y, uint8_t font) {
+    char s[12];
+    snprintf(s, sizeof(s), "%ld", n);
+    return drawString(s, x, y, font);
+}
+
+uint16_t TFT_eSPI::readPixel(int32_t x, int32_t y) {
+    if (!m_buffer || x < 0 || y < 0 || x >= m_width || y >= m_height)
+        return 0;
+    return swap16(m_buffer[y * m_width + x]);
+}
+
+void TFT_eSPI::pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t* data) {
+    for (int32_t j = 0; j < h; ++j)
+        for (int32_t i = 0; i < w; ++i) {
+            uint16_t c = data[j * w + i];
+            drawPixel(x + i, y + j, m_swapBytes ? c : swap16(c));
+        }
+    pixelsPushed += w * h;
+}
+
+void* TFT_eSprite::createSprite(int16_t w, int16_t h) {
+    simBootStep("sprite");
+    deleteSprite();
+    m_width = w;
+    m_height = h;
+    m_buffer = (uint16_t*)calloc(w * h, 2);
+    return m_buffer;
+}
+
+void TFT_eSprite::deleteSprite() {
+    free(m_buffer);
+    m_buffer = nullptr;
+}
+
+void TFT_eSprite::pushSprite(int32_t x, int32_t y) {
+    bool swap = m_tft->getSwapBytes();
+    m_tft->setSwapBytes(false);
+    m_tft->pushImage(x, y, m_width, m_height, m_buffer);
+    m_tft->setSwapBytes(swap);
+}
+
+void MOTOR_Class::onec(int duration) {
+    ++pulses;
+}
+
+TTGOClass* TTGOClass::getWatch() {
+    static TTGOClass watch;
+    static TFT_eSPI tft(240, 240);
+    static AXP20X_Class power;
+    static BMA bma;
+    static MOTOR_Class motor;
+    static FocalTech_Class touch;
+    watch.tft = &tft;
+    watch.touch = &touch;
+    watch.power = &power;
+    watch.bma = &bma;
+    watch.motor = &motor;
+    return &watch;
+}
+
+bool TTGOClass::getTouch(int16_t& x, int16_t& y) {
+    if (!touched)
+        return false;
+    touchMonitor = false;
+    x = touchX;
+    y = touchY;
+    return true;
+}
+
+void BLEMidiServerClass::noteOn(uint8_t chan, uint8_t note, uint8_t vel) {
+    ++messagesSent;
+}
+
+void BLEMidiServerClass::controlChange(uint8_t chan, uint8_t cc, uint8_t val) {
+    ++messagesSent;
+}
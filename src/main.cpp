@@ -16,21 +16,61 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 /* TODO / known issues
-    - Accelometer gestures
     - Only advertise Bluetooth when in settings menu (BLE MIDI library does not support this)
     - Startup splash screen
-    - Internal metronome
     - Use drag from edge for view navigation
-    - OTA update
 */
 
 #include "main.h"
 #include <LilyGoWatch.h> // Provides watch API
 #include <BLEMidi.h> // Provides BLE MIDI interface
-#include <EEPROM.h>
+#include <BLEDevice.h> // Provides access to BLE MIDI characteristic and GAP / GATT events
+#include <BLE2902.h> // Provides client configuration descriptor to enable firmware update status notifications
+#include <BLESecurity.h> // Provides pairing and bonding required for firmware update
+#include <EEPROM.h> // Only used to load settings saved by older firmware
+#include <Preferences.h> // Provides wear levelled key-value storage in flash (NVS)
+#include <freertos/semphr.h>
+#include <esp_freertos_hooks.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#include <esp_ota_ops.h>
+#include <driver/gpio.h>
 #include "Riban_24.h"
-
-#define MAGIC 0x7269626e // Used to check if EEPROM has been initialised
+#include "damage.h"
+#include "spsc.h"
+#include "blemidi.h"
+#include "ratelimit.h"
+#include "perf.h"
+#include "motion.h"
+#include "clock.h"
+#include "power.h"
+#include "settings.h"
+#include "profile.h"
+#include "touch.h"
+#include "scroll.h"
+
+#define MAGIC 0x7269626e // Marks settings saved to EEPROM by firmware before versioned settings
+#define SETTINGS_VERSION 2 // Settings schema version - increment when meaning or range of an existing setting changes and convert older values in loadSettings()
+#define PROFILE_VERSION 1 // Profile schema version - increment when meaning or range of an existing profile field changes and convert older values in loadProfiles()
+#define SETTINGS_SAVE_MS 1000 // Settings and profiles are written to flash once unchanged for this long (ms)
+#define BTN_TEXT_SIZE 16 // Maximum length of button label including terminator
+#define TILE_MAX_W 240 // Width of largest button that is cached as a pre-rendered tile
+#define TILE_MAX_H 72 // Height of largest button that is cached as a pre-rendered tile
+#define PAD_RAMP_STEPS 16 // Quantity of brightness levels in pad pulse colour ramps
+#define BEAT_MS 500 // Free running animation beat period when not locked to MIDI clock (ms)
+#define SYSEX_ID 0x7D // SysEx manufacturer ID (non-commercial) of messages to riband
+#define SYSEX_PAD_LABEL 0x01 // SysEx command to set pad label: F0 7D 01 <pad> <ASCII text> F7
+#define SYSEX_PROFILE_NAME 0x02 // SysEx command to set profile name: F0 7D 02 <profile> <ASCII text> F7
+#define SYSEX_PROFILE_PADS 0x03 // SysEx command to set profile pad notes: F0 7D 03 <profile> <note of pad 0> <note of pad 1> ... F7
+#define SYSEX_PROFILE_NAV 0x04 // SysEx command to set profile navigation button notes: F0 7D 04 <profile> <note of button ID 0> ... F7
+#define SYSEX_PROFILE_ENC 0x05 // SysEx command to set profile encoder strip controllers: F0 7D 05 <profile> <CC of strip 0> ... F7
+#define PROFILE_PC_CHAN 15 // Program change on this MIDI channel (as well as profile channel) selects profile
+#define CC_UNKNOWN 255 // Value of controller in ccValues before any value is received or sent
+#define DMA_BAND_PIXELS 4096 // Size of each display DMA staging buffer (pixels)
+#define TOUCH_RING 16 // Size of touch sample ring
+#define BOOT_ADVERTISE_TARGET_MS 300 // Target time from start of setup() to BLE advertising (ms)
 
 enum mode_enum {
     MODE_NAVIGATE1,
@@ -46,206 +86,576 @@ enum mode_enum {
     MODE_METROLOW,
     MODE_TIMEOUT,
     MODE_BRIGHTNESS,
+    MODE_CCRATE,
+    MODE_ENCCC,
+    MODE_ENCMODE,
+    MODE_PROFILE,
+    MODE_OTA,
     MODE_XY,
+    MODE_TILT,
     MODE_NUM_0, MODE_NUM_1, MODE_NUM_2, MODE_NUM_3, MODE_NUM_4, MODE_NUM_5, MODE_NUM_6, MODE_NUM_7, MODE_NUM_8, MODE_NUM_9,
     MODE_NONE
 };
 
 enum setting_enum {
     SETTING_BLE,
-    SETTING_MIDICHAN,
-    SETTING_CCX,
-    SETTING_CCY,
-    SETTING_METROHIGH,
-    SETTING_METROLOW,
+    SETTING_MIDICHAN, // Held in profile since settings version 2
+    SETTING_CCX, // Held in profile since settings version 2
+    SETTING_CCY, // Held in profile since settings version 2
+    SETTING_METROHIGH, // Held in profile since settings version 2
+    SETTING_METROLOW, // Held in profile since settings version 2
     SETTING_TIMEOUT,
-    SETTING_BRIGHTNESS
+    SETTING_BRIGHTNESS,
+    SETTING_CCRATE,
+    SETTING_ENCCC, // Held in profile since settings version 2
+    SETTING_ENCMODE, // Held in profile since settings version 2
+    SETTING_PROFILE, // Index of active profile
+    SETTING_OTA // Allow firmware update over BLE
 };
 
 TTGOClass* ttgo; // Pointer to singleton instance of ttgo watch object
 BMA* accel; // Pointer to accelerometer sensor
+enum perf_enum {
+    PERF_TOUCH_TO_BLE, // Touch sample to BLE notification of resulting MIDI message
+    PERF_BLE_TO_UI, // BLE MIDI scheduled apply time (or receive if late) to message applied to UI state
+    PERF_BLE_TO_PIXEL, // BLE MIDI scheduled apply time (or receive if late) to display push completed
+    PERF_REFRESH, // Duration of refresh()
+    PERF_PUSH, // Duration of pushing frame to display
+    PERF_RX_JITTER, // BLE MIDI receive delay beyond least delayed message
+    PERF_COUNT
+};
+
+static const char* PERF_NAMES[] = {"touch>ble", "ble>ui", "ble>pixel", "refresh", "push", "rx jitter"};
+
+enum power_enum {
+    POWER_ACTIVE, // Display on at set brightness
+    POWER_DIMMED, // Display on at reduced brightness shortly before switching off
+    POWER_OFF, // Backlight off, display panel asleep, touch controller monitoring, reduced CPU clock
+    POWER_SLEEP, // As off with automatic light sleep between BLE and timer events
+    POWER_COUNT
+};
+
+static const char* POWER_NAMES[] = {"active", "dimmed", "off", "sleep"};
+static const uint16_t POWER_MA[] = {90, 60, 30, 8}; // Estimated battery current in each power state with BLE connected (mA)
+static const uint16_t POWER_CPU_MHZ[] = {240, 160, 80, 80}; // Maximum CPU clock in each power state
+
+enum boot_enum {
+    BOOT_STORAGE, // Settings and profiles loaded, MIDI dispatch ready
+    BOOT_BLE, // BLE MIDI advertising (not reached if BLE disabled)
+    BOOT_WATCH, // Watch hardware initialised
+    BOOT_INPUT, // Buttons, motor, power button, touch and accelerometer configured
+    BOOT_TASKS, // Tasks started - end of setup()
+    BOOT_FRAME, // First frame drawn, including lazy allocation of display buffers
+    BOOT_COUNT
+};
+
+static const char* BOOT_NAMES[] = {"storage", "ble", "watch", "input", "tasks", "frame"};
+
+// Interrupt line that wakes CPU from light sleep
+struct wake_pin_t {
+    uint8_t pin;
+    gpio_int_type_t level; // Level that wakes from light sleep
+    gpio_int_type_t edge; // Edge that triggers interrupt when not sleeping
+};
+
+static const wake_pin_t WAKE_PINS[] = {
+    {TOUCH_INT, GPIO_INTR_LOW_LEVEL, GPIO_INTR_NEGEDGE},
+    {AXP202_INT, GPIO_INTR_LOW_LEVEL, GPIO_INTR_NEGEDGE},
+    {BMA423_INT1, GPIO_INTR_HIGH_LEVEL, GPIO_INTR_POSEDGE}
+};
+
 TFT_eSprite* canvas; // Pointer to sprite acting as display double buffer
 TFT_eSprite* menuCanvas; // Pointer to sprite acting as display double buffer
 TFT_eSprite* statusCanvas; // Pointer to sprite acting as display double buffer
+TFT_eSprite* tileCanvas; // Pointer to scratch sprite used to render button tiles
+DamageList damage(240, 220); // Regions of the visible view that need pushing to the display
+bool redrawAll = true; // True to redraw and push the whole view on next refresh
+uint32_t framePixels = 0; // Quantity of pixels pushed to display during last refresh
+uint16_t* dmaBuffers[2] = {nullptr, nullptr}; // Ping-pong display staging buffers in DMA capable internal RAM, nullptr if DMA unavailable
+uint8_t dmaNext = 0; // Index of staging buffer to fill next
+bool displayBusy = false; // True whilst a display write transaction is open (last band may still be streaming)
+uint32_t pixelsPushed = 0; // Quantity of pixels pushed to display since boot
+LatencyStats perf[PERF_COUNT]; // Rolling latency statistics - see perf_enum
+bool perfOverlay = false; // True to show latency statistics in status bar
+uint32_t touchUs = 0; // Time of most recent touch sample (us)
+volatile uint32_t touchIrqUs = 0; // Time of most recent touch interrupt (us)
+volatile uint32_t touchIrqCount = 0; // Quantity of touch interrupts
+uint32_t touchIrqRead = 0; // Value of touchIrqCount when touch controller was last read
+uint32_t touchSampleUs = 0; // Time touch controller was last read (us)
+SpscQueue<touch_sample_t, TOUCH_RING> touchRing; // Timestamped touch samples from touch controller to touch processing
+TouchFilter touchFilter; // Debounces touch samples
+bool touchTrace = false; // True to write touch samples to serial port
+uint32_t rxPixelUs = 0; // Receive time of oldest incoming MIDI message not yet displayed (us), 0 if none
+
+/*  Geometry, colours, initial label and mode of a button
+    Layouts are constant tables held in flash. Each gfxButton keeps only the state that changes at runtime.
+*/
+struct button_layout_t {
+    int16_t x, y;
+    uint16_t w, h;
+    uint16_t bg, bgh; // Normal & highlighted background colour
+    const char* text; // Initial label, nullptr for none
+    uint8_t mode; // Mode (or value) selected by button
+    uint8_t indent; // Left align label this far from left edge, 0 to centre label
+};
 
 class gfxButton {
     public:
-        gfxButton(TFT_eSprite* canvas, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t bg, uint32_t bgh, const char* text=nullptr, uint8_t mode=MODE_NONE) :
-            m_canvas(canvas), m_x(x), m_y(y), m_w(w), m_h(h), m_bg(bg), m_bgh(bgh), m_mode(mode) {
-                m_fg = TFT_WHITE;
-                m_rad = m_h / 4;
-                m_indent_x = m_w / 2;
-                m_indent_y = m_h / 2;
-                if (text)
-                    setText(text);
-            };
+        // Attach button to canvas and layout. Call once before use.
+        void begin(TFT_eSprite* canvas, const button_layout_t& layout) {
+            m_canvas = canvas;
+            m_layout = &layout;
+            m_x = layout.x;
+            m_y = layout.y;
+            m_bg = layout.bg;
+            m_mode = layout.mode;
+            if (layout.text)
+                setText(layout.text);
+        }
 
         void setText(const char* text) {
-            free(m_text);
-            m_text = (char*)malloc(strlen(text) + 1);
-            sprintf(m_text, text);
+            if (strncmp(m_text, text, sizeof(m_text) - 1) == 0)
+                return;
+            size_t len = 0;
+            while (len < sizeof(m_text) - 1 && text[len])
+                ++len; // Longer labels are truncated
+            memcpy(m_text, text, len);
+            m_text[len] = '\0';
+            m_dirty = true;
+            m_tileValid[0] = m_tileValid[1] = false;
+        }
+
+        void setBg(uint32_t bg) {
+            if (bg == m_bg)
+                return;
+            m_bg = bg;
+            m_dirty = true;
+            m_tileValid[0] = false;
+        }
+
+        void setFg(uint32_t fg) {
+            if (fg == m_fg)
+                return;
+            m_fg = fg;
+            m_dirty = true;
+            m_tileValid[0] = m_tileValid[1] = false;
+        }
+
+        // Force redraw on next update
+        void invalidate() {
+            m_dirty = true;
+        }
+
+        // Draw button only if its appearance has changed since last drawn
+        void update(bool hl=false) {
+            if (m_dirty || hl != m_hl)
+                draw(hl);
         }
 
         void draw(bool hl=false) {
-            m_canvas->fillRoundRect(m_x, m_y, m_w, m_h, m_rad, hl?m_bgh:m_bg);
-            if (m_text) {
-                m_canvas->setTextColor(m_fg);
-                m_canvas->setTextDatum(m_align);
-                m_canvas->drawString(m_text, m_x + m_indent_x, m_y + m_indent_y, 1);
-                m_canvas->setTextDatum(TL_DATUM);
+            if (!m_tilesAllocated) {
+                // Cache each appearance as a tile in PSRAM, allocated when first drawn. Without PSRAM buttons are drawn directly to save internal RAM.
+                if (psramFound() && m_layout->w <= TILE_MAX_W && m_layout->h <= TILE_MAX_H) {
+                    m_tiles[0] = (uint16_t*)ps_malloc(m_layout->w * m_layout->h * 2);
+                    m_tiles[1] = (uint16_t*)ps_malloc(m_layout->w * m_layout->h * 2);
+                }
+                m_tilesAllocated = true;
+            }
+            if (m_tiles[hl]) {
+                if (!m_tileValid[hl])
+                    renderTile(hl);
+                blit(m_tiles[hl]);
+            } else {
+                render(m_canvas, m_x, m_y, hl);
             }
+            m_hl = hl;
+            m_dirty = false;
+            damage.add(m_x, m_y, m_layout->w, m_layout->h);
         }
 
         void drawBar(uint16_t percent) {
-            uint16_t x = percent * m_w / 100;
-            m_canvas->fillRoundRect(m_x, m_y, m_w, m_h, m_rad, m_bg);
-            m_canvas->fillRoundRect(m_x, m_y, x, m_h, m_rad, m_bgh);
-            if (m_text) {
+            uint16_t x = percent * m_layout->w / 100;
+            damage.add(m_x, m_y, m_layout->w, m_layout->h);
+            m_canvas->fillRoundRect(m_x, m_y, m_layout->w, m_layout->h, radius(), m_bg);
+            m_canvas->fillRoundRect(m_x, m_y, x, m_layout->h, radius(), m_layout->bgh);
+            if (m_text[0]) {
                 m_canvas->setTextColor(m_fg);
-                m_canvas->setTextDatum(m_align);
-                m_canvas->drawString(m_text, m_x + m_indent_x, m_y + m_indent_y, 1);
+                m_canvas->setTextDatum(align());
+                m_canvas->drawString(m_text, m_x + indentX(), m_y + indentY(), 1);
                 m_canvas->setTextDatum(TL_DATUM);
             }
         }
 
+        // Rasterise button at given position of a sprite
+        void render(TFT_eSprite* sprite, int16_t x, int16_t y, bool hl) {
+            sprite->fillRoundRect(x, y, m_layout->w, m_layout->h, radius(), hl?m_layout->bgh:m_bg);
+            if (m_text[0]) {
+                sprite->setTextColor(m_fg);
+                sprite->setTextDatum(align());
+                sprite->drawString(m_text, x + indentX(), y + indentY(), 1);
+                sprite->setTextDatum(TL_DATUM);
+            }
+        }
+
+        // Render an appearance into its tile via the scratch sprite
+        void renderTile(bool hl) {
+            tileCanvas->fillRect(0, 0, m_layout->w, m_layout->h, TFT_BLACK);
+            render(tileCanvas, 0, 0, hl);
+            uint16_t* src = (uint16_t*)tileCanvas->getPointer();
+            for (int16_t row = 0; row < m_layout->h; ++row)
+                memcpy(m_tiles[hl] + row * m_layout->w, src + row * TILE_MAX_W, m_layout->w * 2);
+            m_tileValid[hl] = true;
+        }
+
+        // Copy a tile to the canvas, clipped to the canvas bounds
+        void blit(const uint16_t* tile) {
+            int16_t cw = m_canvas->width();
+            int16_t ch = m_canvas->height();
+            int16_t x1 = m_x < 0 ? 0 : m_x;
+            int16_t x2 = m_x + m_layout->w > cw ? cw : m_x + m_layout->w;
+            int16_t y1 = m_y < 0 ? 0 : m_y;
+            int16_t y2 = m_y + m_layout->h > ch ? ch : m_y + m_layout->h;
+            if (x1 >= x2 || y1 >= y2)
+                return;
+            uint16_t* dst = (uint16_t*)m_canvas->getPointer();
+            for (int16_t y = y1; y < y2; ++y)
+                memcpy(dst + y * cw + x1, tile + (y - m_y) * m_layout->w + x1 - m_x, (x2 - x1) * 2);
+        }
+
         bool bounds(uint16_t x, uint16_t y) {
-            return (x >= m_x && x <= (m_x + m_w) && y >= m_y && y <= (m_y + m_h));
+            return (x >= m_x && x <= (m_x + m_layout->w) && y >= m_y && y <= (m_y + m_layout->h));
         }
 
         uint8_t getMode() {
             return m_mode;
         }
 
-    TFT_eSprite* m_canvas;
-    uint32_t m_bg, m_bgh, m_fg;
-    uint32_t time = 0;
-    int16_t m_x, m_y, m_w, m_h;
-    uint8_t m_rad;
-    uint8_t m_mode = MODE_NONE;
-    uint8_t m_indent_x;
-    uint8_t m_indent_y;
-    uint8_t m_align = MC_DATUM;
-    char * m_text = nullptr;
+        uint16_t width() const {
+            return m_layout->w;
+        }
+
+    private:
+        uint8_t radius() const {
+            return m_layout->h / 4;
+        }
+
+        // Text datum and position of label relative to button origin
+        uint8_t align() const {
+            return m_layout->indent ? ML_DATUM : MC_DATUM;
+        }
+
+        int16_t indentX() const {
+            return m_layout->indent ? m_layout->indent : m_layout->w / 2;
+        }
+
+        int16_t indentY() const {
+            return m_layout->h / 2;
+        }
+
+    public:
+        TFT_eSprite* m_canvas = nullptr;
+        const button_layout_t* m_layout = nullptr;
+        uint32_t m_bg = 0, m_fg = TFT_WHITE;
+        int16_t m_x = 0, m_y = 0; // Current position (settings buttons scroll)
+        uint8_t m_mode = MODE_NONE;
+        char m_text[BTN_TEXT_SIZE] = ""; // Label (truncated to fit)
+        bool m_dirty = true; // True if appearance changed since last drawn
+        bool m_hl = false; // Highlight state when last drawn
+        uint16_t* m_tiles[2] = {nullptr, nullptr}; // Pre-rendered normal & highlighted appearance, nullptr if not cached
+        bool m_tileValid[2] = {false, false}; // True if corresponding tile matches current appearance
+        bool m_tilesAllocated = false; // True once tile allocation has been attempted
 };
 
-uint8_t settings[] = {0, 15, 101, 102, 75, 76, 100, 60}; // Array of 8-bit settings - see setting_enum
+uint8_t settings[] = {0, 15, 101, 102, 75, 76, 100, 60, 5, 71, 0, 0, 0}; // Array of 8-bit settings - see setting_enum
+Profile profiles[PROFILE_COUNT]; // Performance profiles
+Profile* profile = &profiles[0]; // Active profile
 uint8_t settingsSize = sizeof(settings);
-int16_t settingsOffset = 0; // Settings view scroll position
+ScrollList settingsList(55, 220, sizeof(settings)); // Settings view scroll position and fling
 uint8_t pulseRadius = 0; // Radius of pulse cirle (decreases over time)
 uint8_t lastPulseRadius = 0; // Radius of last pulse cirle (used to clear circle)
 uint8_t mode = MODE_NAVIGATE1; // Menu / display mode
 bool menuShowing = true; // True when menu view showing
 uint8_t selPad = 255; // Index of selected pad
 uint8_t oskSel = MODE_NONE; // Index of button selected on touch screen
+uint32_t numPadClose = 0; // Time (millis) to close numeric keypad after showing entered value, 0 whilst entering
 uint8_t crosshair_x = 120, crosshair_y = 110; // Coordinates of X-Y controller crosshairs
+uint8_t tilt_x = 120, tilt_y = 110; // Coordinates of tilt controller crosshairs
+uint8_t ccValues[16][128]; // Last value of each controller (by channel & CC) received or sent, CC_UNKNOWN if none
+OneEuroFilter tiltFilters[2]; // Roll & pitch jitter filters
+ChangeThreshold tiltThresholds[2]; // Roll & pitch change detectors
 uint8_t battery; // Battery %
 bool charging; // Battery %
 volatile uint32_t screenTimeout = 0; // Countdown timer until auto standby mode
 uint32_t now = 0; // Time of current loop process
-uint32_t cpuLoad = 0; // Main loop cycles per ms
+uint32_t cpuLoad = 0; // Application core load (%)
+volatile uint32_t idleCount = 0; // Quantity of idle hook calls on application core since last load calculation
+uint32_t bootHeap = 0; // Free internal heap once booted, i.e. after first frame (bytes)
+uint32_t lowHeap = 0; // Lowest free internal heap sampled since boot (bytes)
+uint32_t bootStartUs = 0; // Time setup() started (us since application start)
+uint32_t bootUs[BOOT_COUNT]; // Time each boot phase completed (us since start of setup()) - see boot_enum
+uint8_t bootDone = 0; // Bitmask of boot phases completed
 bool standby = true; // True if in standby mode (screen off)
+uint8_t powerState = POWER_ACTIVE; // Current power state - see power_enum
+PowerResidency powerStats(POWER_MA, POWER_COUNT); // Time spent in each power state
+bool lightSleepAvailable = false; // True if automatic light sleep can be enabled
+volatile bool sleepWakeArmed = false; // True whilst interrupt lines are level triggered to wake from light sleep
+portMUX_TYPE sleepWakeMux = portMUX_INITIALIZER_UNLOCKED; // Protects interrupt line configuration changed by task and ISR
+bool displayAsleep = false; // True if display panel is in sleep mode
+uint8_t offSeconds = 0; // Seconds since display switched off (saturates)
+bool backlightPending = false; // True to switch on backlight after next refresh
 bool touching = false; // True if screen touched
-volatile bool irq = false;
+volatile bool irq = false; // True when power management IRQ pending
+volatile bool accelIrq = false; // True when accelerometer IRQ pending
 int16_t topDrag = 0; // Y position of top drag down
 int16_t bottomDrag = 240; // Y position of top drag up
 int16_t leftDrag = 0; // X position of drag from left
 int16_t rightDrag = 240; // X position of drag from right
 uint8_t padFlashing[16]; // Pad flash mode (0:Static, 1:Flash, 2:Pulse)
-bool flash = false;
+uint8_t padColour[16]; // Pad colour index (into PAD_COLOURS)
+uint16_t padRamps[sizeof(PAD_COLOURS) / sizeof(PAD_COLOURS[0])][PAD_RAMP_STEPS]; // Pulse brightness levels of each pad colour, dimmest first
+uint32_t beatStart = 0; // Time of start of a beat (ms), used as animation phase reference
+uint32_t beatPeriod = BEAT_MS; // Duration of a beat (ms)
+
+// Task priorities - higher value is higher priority
+#define INPUT_TASK_PRIORITY 3
+#define MIDI_TASK_PRIORITY 2
+#define RENDER_TASK_PRIORITY 1
+#define STORAGE_TASK_PRIORITY 0
+#define TOUCH_POLL_MS 10 // Touch sample period whilst screen is touched if touch interrupts stop (ms)
+#define TILT_RATE 100 // Tilt controller sample rate (Hz) - matches accelerometer output data rate
+#define TILT_ONE_G 1024 // Accelerometer reading for 1g at 2g range
+#define TILT_THRESHOLD 2 // Minimum change of tilt controller value to send
+#define IDLE_POLL_MS 1000 // Input sample period whilst screen is not touched (inputs normally wake input task by interrupt)
+#define MIDI_BATCH 16 // Maximum quantity of incoming MIDI messages applied per UI lock
+#define MIDI_TX_INTERVAL 15 // Default outgoing MIDI flush period (ms) until connection interval is known
+#define BEATS_PER_BAR 4 // Metronome beats per bar - first beat of bar uses high pulse
+#define METRO_HIGH_MS 60 // Metronome haptic pulse duration on first beat of bar (ms)
+#define METRO_LOW_MS 30 // Metronome haptic pulse duration on other beats (ms)
+#define RENDER_MS 50 // Display refresh period (ms)
+#define STANDBY_RENDER_MS 1000 // Housekeeping period whilst display is off (ms)
+#define POWER_DIM_S 5 // Display dims this long before switching off (s)
+#define POWER_DIM_DIV 4 // Dimmed brightness is set brightness divided by this
+#define POWER_SLEEP_S 10 // Light sleep starts this long after display switches off (s)
+#define POWER_MIN_MHZ 80 // Minimum CPU clock when idle (lowest that keeps APB clock for BLE and SPI)
+#define OTA_RING 8 // Quantity of firmware update commands and data writes queued for storage task
+#define OTA_CONN_MIN 6 // Minimum connection interval requested during firmware update (units of 1.25ms)
+#define OTA_CONN_MAX 12 // Maximum connection interval requested during firmware update (units of 1.25ms)
+#define OTA_RESTART_MS 500 // Delay between notifying completed firmware update and restarting (ms)
+
+TaskHandle_t inputTaskHandle = nullptr; // Handle of task processing touch, button and accelerometer
+TaskHandle_t midiTaskHandle = nullptr; // Handle of task processing incoming MIDI
+TaskHandle_t renderTaskHandle = nullptr; // Handle of task updating display and housekeeping
+TaskHandle_t storageTaskHandle = nullptr; // Handle of task writing settings to flash
+Preferences prefs; // Settings storage
+settings_record_t storedSettings = {}; // Settings record last read from or written to flash
+bool settingsDirty = false; // True if settings have changed since written to flash
+uint8_t profilesDirty = 0; // Bitmask of profiles changed since written to flash
+uint32_t storedProfileCrc[PROFILE_COUNT] = {}; // CRC of profile record last read from or written to flash
+uint32_t settingsChanged = 0; // Time settings or profiles last changed (ms)
+uint32_t settingsWrites = 0; // Quantity of settings and profile records written to flash since boot
+SpscQueue<midi_event_t, 64> midiRx; // Incoming MIDI messages from BLE callbacks
+BleMidiDecoder midiDecoder; // Parses incoming BLE MIDI packets
+BleMidiTimebase rxTimebase; // Maps incoming BLE MIDI timestamps to local time
+uint32_t rxLate = 0; // Quantity of incoming MIDI messages received after their scheduled apply time
+SpscQueue<sysex_t, 4> sysexRx; // Incoming SysEx message bodies, each matched by a 0xF0 message in midiRx
+uint8_t sysexSeq = 0; // Sequence number of next incoming SysEx message
+midi_handler_t midiHandlers[128] = {}; // Incoming MIDI message handlers indexed by status byte & 0x7F, nullptr to ignore
+SpscQueue<midi_event_t, 64> midiTx; // Outgoing MIDI messages from input task (timestamp is ms)
+BleMidiEncoder midiPacket; // Outgoing BLE MIDI packet being built
+BLECharacteristic* midiCharacteristic = nullptr; // BLE MIDI characteristic used to notify outgoing packets
+volatile uint16_t bleConnInterval = MIDI_TX_INTERVAL; // Current BLE connection interval (ms)
+volatile uint16_t bleMtu = 23; // Current negotiated BLE MTU
+BLECharacteristic* otaControl = nullptr; // Firmware update command and status characteristic
+BLECharacteristic* otaData = nullptr; // Firmware update image data characteristic
+SpscQueue<ota_rx_t, OTA_RING> otaRx; // Firmware update commands and data from BLE callbacks to storage task
+OtaSession otaSession; // Progress of firmware image being received
+esp_ota_handle_t otaHandle = 0; // Handle of update partition being written, 0 if none
+const esp_partition_t* otaPartition = nullptr; // Partition receiving firmware image
+uint8_t otaPeer[6] = {}; // Address of client sending firmware update
+uint32_t otaStart = 0; // Time firmware update session started (ms)
+volatile uint8_t otaProgress = 255; // Percentage of firmware image received, 255 if no update in progress
+uint32_t lastTxFlush = 0; // Time of last outgoing MIDI flush (ms)
+RateLimiter ccLimiters[2]; // Rate limiters for X & Y controllers
+StepLimiter encLimiters[4]; // Rate limiters for encoder strips in relative mode
+RateLimiter encCcLimiters[4]; // Rate limiters for encoder strips in absolute mode
+bool thinningPending = false; // True if rate limiters are holding back values
+uint32_t txPackets = 0; // Quantity of outgoing BLE MIDI packets sent
+uint32_t txMessages = 0; // Quantity of outgoing MIDI messages sent
+uint8_t txMaxPerPacket = 0; // Most MIDI messages sent in one packet
+SemaphoreHandle_t uiMutex; // Protects UI state shared between tasks
+ClockPll clockPll; // Tracks incoming MIDI clock
+SemaphoreHandle_t clockMutex; // Protects clockPll and nextBeat, shared by MIDI task and beat timer
+esp_timer_handle_t beatTimer; // Fires on each metronome beat
+int32_t nextBeat = -1; // Clock position of next scheduled metronome beat, -1 if none scheduled
+SpscQueue<beat_t, 4> beatRx; // Metronome beats from beat timer to render task, which applies them to pulse and pad animation under uiMutex
+
+// Button layouts (x, y, w, h, bg, bgh, text, mode, indent)
+static constexpr button_layout_t MENU_LAYOUT[] = {
+    {10, 10, 62, 60, 0x22ad, 0xa514, "Nav", MODE_NAVIGATE1, 0},
+    {87, 10, 62, 60, 0x22ad, 0xa514, "Pads", MODE_PADS, 0},
+    {164, 10, 62, 60, 0x22ad, 0xa514, "ENC", MODE_ENCODERS, 0},
+    {10, 80, 62, 60, 0x22ad, 0xa514, "XY", MODE_XY, 0},
+    {87, 80, 62, 60, 0x22ad, 0xa514, "Conf", MODE_SETTINGS, 0},
+    {164, 80, 62, 60, 0x22ad, 0xa514, "Tilt", MODE_TILT, 0},
+    {10, 150, 216, 60, 0x22ad, 0xa514, nullptr, MODE_PROFILE, 0} // Shows active profile name
+};
+
+// Settings rows, indexed by setting_enum. Rows are repositioned as the view scrolls.
+static constexpr button_layout_t SETTINGS_LAYOUT[] = {
+    {5, 0, 230, 54, 0x22ad, 0xa514, "BLE", MODE_BLE, 10},
+    {5, 55, 230, 54, 0x22ad, 0xa514, "MIDI Chan", MODE_MIDICHAN, 10},
+    {5, 110, 235, 54, 0x22ad, 0xa514, "X-CC", MODE_CCX, 10},
+    {5, 165, 235, 54, 0x22ad, 0xa514, "Y-CC", MODE_CCY, 10},
+    {5, 220, 235, 54, 0x22ad, 0xa514, "Metro High", MODE_METROHIGH, 10},
+    {5, 275, 235, 54, 0x22ad, 0xa514, "Metro Low", MODE_METROLOW, 10},
+    {5, 330, 235, 54, 0x22ad, 0xa514, "Sleep", MODE_TIMEOUT, 10},
+    {5, 385, 235, 54, 0x22ad, 0xa514, "Brightness", MODE_BRIGHTNESS, 10},
+    {5, 440, 235, 54, 0x22ad, 0xa514, "CC Rate", MODE_CCRATE, 10},
+    {5, 495, 235, 54, 0x22ad, 0xa514, "Enc CC", MODE_ENCCC, 10},
+    {5, 550, 235, 54, 0x22ad, 0xa514, "Enc Mode", MODE_ENCMODE, 10},
+    {5, 605, 235, 54, 0x22ad, 0xa514, "Profile", MODE_PROFILE, 10},
+    {5, 660, 235, 54, 0x22ad, 0xa514, "BLE Update", MODE_OTA, 10}
+};
+
+// Screen timeout choices, mode is timeout (s), 255 to cancel
+static constexpr button_layout_t SLEEP_LAYOUT[] = {
+    {15, 0, 100, 50, 0x22ad, 0xa514, "\x83", 255, 0},
+    {125, 0, 100, 50, 0x22ad, 0xa514, "15s", 15, 0},
+    {15, 55, 100, 50, 0x22ad, 0xa514, "30s", 30, 0},
+    {125, 55, 100, 50, 0x22ad, 0xa514, "1 min", 60, 0},
+    {15, 110, 100, 50, 0x22ad, 0xa514, "2 mins", 120, 0},
+    {125, 110, 100, 50, 0x22ad, 0xa514, "3 mins", 180, 0},
+    {15, 165, 100, 50, 0x22ad, 0xa514, "4 mins", 240, 0},
+    {125, 165, 100, 50, 0x22ad, 0xa514, "None", 0, 0}
+};
+
+// Profile selection grid, mode is profile index, labels are profile names
+static constexpr button_layout_t PROFILE_LAYOUT[PROFILE_COUNT] = {
+    {5, 0, 110, 50, 0x22ad, 0x0680, nullptr, 0, 0},
+    {125, 0, 110, 50, 0x22ad, 0x0680, nullptr, 1, 0},
+    {5, 55, 110, 50, 0x22ad, 0x0680, nullptr, 2, 0},
+    {125, 55, 110, 50, 0x22ad, 0x0680, nullptr, 3, 0},
+    {5, 110, 110, 50, 0x22ad, 0x0680, nullptr, 4, 0},
+    {125, 110, 110, 50, 0x22ad, 0x0680, nullptr, 5, 0},
+    {5, 165, 110, 50, 0x22ad, 0x0680, nullptr, 6, 0},
+    {125, 165, 110, 50, 0x22ad, 0x0680, nullptr, 7, 0}
+};
+
+// Launch pads, numbered down each column (background colour is PAD_COLOURS[0])
+static constexpr button_layout_t PAD_LAYOUT[] = {
+    {0, 0, 59, 54, 0x3186, 0x4208, nullptr, MODE_NONE, 0},
+    {0, 55, 59, 54, 0x3186, 0x4208, nullptr, MODE_NONE, 0},
+    {0, 110, 59, 54, 0x3186, 0x4208, nullptr, MODE_NONE, 0},
+    {0, 165, 59, 54, 0x3186, 0x4208, nullptr, MODE_NONE, 0},
+    {60, 0, 59, 54, 0x3186, 0x4208, nullptr, MODE_NONE, 0},
+    {60, 55, 59, 54, 0x3186, 0x4208, nullptr, MODE_NONE, 0},
+    {60, 110, 59, 54, 0x3186, 0x4208, nullptr, MODE_NONE, 0},
+    {60, 165, 59, 54, 0x3186, 0x4208, nullptr, MODE_NONE, 0},
+    {120, 0, 59, 54, 0x3186, 0x4208, nullptr, MODE_NONE, 0},
+    {120, 55, 59, 54, 0x3186, 0x4208, nullptr, MODE_NONE, 0},
+    {120, 110, 59, 54, 0x3186, 0x4208, nullptr, MODE_NONE, 0},
+    {120, 165, 59, 54, 0x3186, 0x4208, nullptr, MODE_NONE, 0},
+    {180, 0, 59, 54, 0x3186, 0x4208, nullptr, MODE_NONE, 0},
+    {180, 55, 59, 54, 0x3186, 0x4208, nullptr, MODE_NONE, 0},
+    {180, 110, 59, 54, 0x3186, 0x4208, nullptr, MODE_NONE, 0},
+    {180, 165, 59, 54, 0x3186, 0x4208, nullptr, MODE_NONE, 0}
+};
+
+// Navigation grid, labels and modes are set from BTN_IDS by updateNavigationButtons()
+static constexpr button_layout_t NAV_LAYOUT[] = {
+    {0, 0, 79, 72, 0x50ed, TFT_DARKGREY, nullptr, MODE_NONE, 0},
+    {80, 0, 79, 72, 0x50ed, TFT_DARKGREY, nullptr, MODE_NONE, 0},
+    {160, 0, 79, 72, 0x50ed, TFT_DARKGREY, nullptr, MODE_NONE, 0},
+    {0, 73, 79, 72, 0x50ed, TFT_DARKGREY, nullptr, MODE_NONE, 0},
+    {80, 73, 79, 72, 0x50ed, TFT_DARKGREY, nullptr, MODE_NONE, 0},
+    {160, 73, 79, 72, 0x50ed, TFT_DARKGREY, nullptr, MODE_NONE, 0},
+    {0, 146, 79, 72, 0x50ed, TFT_DARKGREY, nullptr, MODE_NONE, 0},
+    {80, 146, 79, 72, 0x50ed, TFT_DARKGREY, nullptr, MODE_NONE, 0},
+    {160, 146, 79, 72, 0x50ed, TFT_DARKGREY, nullptr, MODE_NONE, 0}
+};
+
+// Numeric keypad, mode is digit. Last button displays the entry.
+static constexpr button_layout_t NUMPAD_LAYOUT[] = {
+    {0, 0, 78, 54, TFT_DARKGREY, 0xa514, "0", 0, 0},
+    {0, 55, 78, 54, TFT_DARKGREY, 0xa514, "1", 1, 0},
+    {80, 55, 78, 54, TFT_DARKGREY, 0xa514, "2", 2, 0},
+    {160, 55, 78, 54, TFT_DARKGREY, 0xa514, "3", 3, 0},
+    {0, 110, 78, 54, TFT_DARKGREY, 0xa514, "4", 4, 0},
+    {80, 110, 78, 54, TFT_DARKGREY, 0xa514, "5", 5, 0},
+    {160, 110, 78, 54, TFT_DARKGREY, 0xa514, "6", 6, 0},
+    {0, 165, 78, 54, TFT_DARKGREY, 0xa514, "7", 7, 0},
+    {80, 165, 78, 54, TFT_DARKGREY, 0xa514, "8", 8, 0},
+    {160, 165, 78, 54, TFT_DARKGREY, 0xa514, "9", 9, 0},
+    {80, 0, 158, 54, 0xa514, TFT_DARKGREY, "   ", 10, 0}
+};
 
-gfxButton* menuBtns[5];
-gfxButton* settingsBtns[sizeof(settings)];
-gfxButton* navigationBtns[9];
-gfxButton* launchPads[16];
-gfxButton* numPad[11];
-gfxButton* sleepBtns[8];
+static_assert(sizeof(SETTINGS_LAYOUT) / sizeof(button_layout_t) == sizeof(settings), "Settings layout must have a row for each setting");
+
+gfxButton menuBtns[sizeof(MENU_LAYOUT) / sizeof(button_layout_t)];
+gfxButton settingsBtns[sizeof(settings)];
+gfxButton navigationBtns[sizeof(NAV_LAYOUT) / sizeof(button_layout_t)];
+gfxButton launchPads[sizeof(PAD_LAYOUT) / sizeof(button_layout_t)];
+gfxButton numPad[sizeof(NUMPAD_LAYOUT) / sizeof(button_layout_t)];
+gfxButton sleepBtns[sizeof(SLEEP_LAYOUT) / sizeof(button_layout_t)];
+gfxButton profileBtns[PROFILE_COUNT];
+
+// Attach each button of an array to a canvas and its layout
+void beginButtons(gfxButton* btns, const button_layout_t* layouts, uint8_t count, TFT_eSprite* sprite) {
+    for (uint8_t i = 0; i < count; ++i)
+        btns[i].begin(sprite, layouts[i]);
+}
 
 // Initialisation
 void setup(void)
 {
+    // BLE MIDI starts advertising first so that a host can reconnect as soon as possible after power on
+    bootStartUs = micros();
     Serial.begin(115200); // Can use USB for debug
-    
+    // Created before loading settings because converting older settings requests saving, which locks UI
+    uiMutex = xSemaphoreCreateRecursiveMutex();
+    clockMutex = xSemaphoreCreateMutex();
+    prefs.begin("riband");
+    loadStorage();
+    memset(ccValues, CC_UNKNOWN, sizeof(ccValues));
+    lockUi();
+    bindMidiHandlers();
+    unlockUi();
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = onBeatTimer;
+    timerArgs.name = "beat";
+    esp_timer_create(&timerArgs, &beatTimer);
+    bootMark(BOOT_STORAGE);
+
+    if (settings[SETTING_BLE]) {
+        startBle(); // Incoming MIDI is queued until MIDI task starts
+        bootMark(BOOT_BLE);
+    }
+
     ttgo = TTGOClass::getWatch(); // Create instance of watch object (singleton)
     ttgo->begin(); // Initialise watch object
     ttgo->tft->fillScreen(TFT_BLACK);
+    ttgo->setBrightness(settings[SETTING_BRIGHTNESS]);
+    // Sprite buffers are allocated when first drawn - see initDisplay()
     canvas = new TFT_eSprite(ttgo->tft);
-    canvas->createSprite(240, 300);
-    canvas->setFreeFont(&Riban_24);
     menuCanvas = new TFT_eSprite(ttgo->tft);
-    menuCanvas->createSprite(240, 240);
-    menuCanvas->setFreeFont(&Riban_24);
     statusCanvas = new TFT_eSprite(ttgo->tft);
-    statusCanvas->createSprite(240, 20);
-    statusCanvas->setFreeFont(&Riban_24);
-    
-    EEPROM.begin(settingsSize + 4);
-    uint32_t magic;
-    EEPROM.readBytes(settingsSize, &magic, 4);
-    if (magic == MAGIC) {
-        EEPROM.readBytes(0, settings, settingsSize);
-        ttgo->setBrightness(settings[SETTING_BRIGHTNESS]);
-    }
-
-    menuBtns[0] = new gfxButton(menuCanvas, 10, 10, 62, 60, 0x22ad, 0xa514, "Nav", MODE_NAVIGATE1);
-    menuBtns[1] = new gfxButton(menuCanvas, 87, 10, 62, 60, 0x22ad, 0xa514, "Pads", MODE_PADS);
-    menuBtns[2] = new gfxButton(menuCanvas, 164, 10, 62, 60, 0x22ad, 0xa514, "ENC", MODE_ENCODERS);
-    menuBtns[3] = new gfxButton(menuCanvas, 10, 80, 62, 60, 0x22ad, 0xa514, "XY", MODE_XY);
-    menuBtns[4] = new gfxButton(menuCanvas, 87, 80, 62, 60, 0x22ad, 0xa514, "Conf", MODE_SETTINGS);
-
-    settingsBtns[0] = new gfxButton(canvas, 5, 0, 230, 54, 0x22ad, 0xa514, "BLE", MODE_BLE);
-    settingsBtns[1] = new gfxButton(canvas, 5, 55, 230, 54, 0x22ad, 0xa514, "MIDI Chan", MODE_MIDICHAN);
-    settingsBtns[2] = new gfxButton(canvas, 5, 120, 235, 54, 0x22ad, 0xa514, "X-CC", MODE_CCX);
-    settingsBtns[3] = new gfxButton(canvas, 5, 165, 235, 54, 0x22ad, 0xa514, "Y-CC", MODE_CCY);
-    settingsBtns[4] = new gfxButton(canvas, 5, 230, 235, 54, 0x22ad, 0xa514, "Metro High", MODE_METROHIGH);
-    settingsBtns[5] = new gfxButton(canvas, 5, 275, 235, 54, 0x22ad, 0xa514, "Metro Low", MODE_METROLOW);
-    settingsBtns[6] = new gfxButton(canvas, 5, 340, 235, 54, 0x22ad, 0xa514, "Sleep", MODE_TIMEOUT);
-    settingsBtns[7] = new gfxButton(canvas, 5, 395, 235, 54, 0x22ad, 0xa514, "Brightness", MODE_BRIGHTNESS);
-    for (uint8_t i = 0; i < settingsSize; ++i) {
-        gfxButton* btn = settingsBtns[i];
-        btn->m_align = ML_DATUM;
-        btn->m_indent_x = 10;
-    }
-
-    sleepBtns[0] = new gfxButton(canvas, 15, 0, 100, 50, 0x22ad, 0xa514, "\x83", 255);
-    sleepBtns[1] = new gfxButton(canvas, 125, 0, 100, 50, 0x22ad, 0xa514, "15s", 15);
-    sleepBtns[2] = new gfxButton(canvas, 15, 55, 100, 50, 0x22ad, 0xa514, "30s", 30);
-    sleepBtns[3] = new gfxButton(canvas, 125, 55, 100, 50, 0x22ad, 0xa514, "1 min", 60);
-    sleepBtns[4] = new gfxButton(canvas, 15, 110, 100, 50, 0x22ad, 0xa514, "2 mins", 120);
-    sleepBtns[5] = new gfxButton(canvas, 125, 110, 100, 50, 0x22ad, 0xa514, "3 mins", 180);
-    sleepBtns[6] = new gfxButton(canvas, 15, 165, 100, 50, 0x22ad, 0xa514, "4 mins", 240);
-    sleepBtns[7] = new gfxButton(canvas, 125, 165, 100, 50, 0x22ad, 0xa514, "None", 0);
-
-    // Build launchpad grid
-    uint8_t i = 0;
-    for (uint8_t col = 0; col < 4; ++col) {
-        for (uint8_t row = 0; row < 4; ++row) {
-            launchPads[i] = new gfxButton(canvas, col * 60, row * 55, 59, 54, PAD_COLOURS[0], 0x4208);
-            ++i;
-        }
-    }
-
-    // Build navigation grid
-    i = 0;
-    for (uint8_t row = 0; row < 3; ++row) {
-        for (uint8_t col = 0; col < 3; ++col) {
-            uint8_t id = BTN_IDS[i];
-            navigationBtns[i] = new gfxButton(canvas, col * 80, row * 73, 79, 72, 0x50ed, TFT_DARKGREY, BTN_LABELS[id], id);
-            ++i;
-        }
-    }
-
-    // Build numeric keyapd
-    numPad[0] = new gfxButton(canvas, 0, 0, 78, 54, TFT_DARKGREY, 0xa514, "0", 0);
-    char txt[2];
-    for (uint8_t col = 0; col < 3; ++col) {
-        for (uint8_t row = 0; row < 3; ++row) {
-            uint8_t i = col + row * 3 + 1;
-            sprintf(txt, "%d", i);
-            numPad[i] = new gfxButton(canvas, col * 80, 55 + row * 55, 78, 54, TFT_DARKGREY, 0xa514, txt, i);
-        }
-    }
-    numPad[10] = new gfxButton(canvas, 80, 0, 158, 54, 0xa514, TFT_DARKGREY, "   ", 10);
-    numPad[10]->m_fg = TFT_BLACK;
+    tileCanvas = new TFT_eSprite(ttgo->tft);
+    bootMark(BOOT_WATCH);
+
+    // Button tiles are rendered when each button is first drawn
+    beginButtons(menuBtns, MENU_LAYOUT, 7, menuCanvas);
+    menuBtns[6].setText(profile->name);
+    beginButtons(settingsBtns, SETTINGS_LAYOUT, settingsSize, canvas);
+    beginButtons(sleepBtns, SLEEP_LAYOUT, 8, canvas);
+    beginButtons(profileBtns, PROFILE_LAYOUT, PROFILE_COUNT, canvas);
+    for (uint8_t i = 0; i < PROFILE_COUNT; ++i)
+        profileBtns[i].setText(profiles[i].name);
+    buildPadRamps();
+    beginButtons(launchPads, PAD_LAYOUT, 16, canvas);
+    beginButtons(navigationBtns, NAV_LAYOUT, 9, canvas);
+    updateNavigationButtons();
+    beginButtons(numPad, NUMPAD_LAYOUT, 11, canvas);
+    numPad[10].setFg(TFT_BLACK);
 
     // Initialise haptic feedback motor
     ttgo->motor_begin();
@@ -254,10 +664,16 @@ void setup(void)
     pinMode(AXP202_INT, INPUT_PULLUP);
     attachInterrupt(AXP202_INT, [] {
         irq = true;
+        wakeInput();
     }, FALLING);
     ttgo->power->enableIRQ(AXP202_PEK_SHORTPRESS_IRQ | AXP202_PEK_LONGPRESS_IRQ| AXP202_VBUS_REMOVED_IRQ | AXP202_VBUS_CONNECT_IRQ | AXP202_CHARGING_IRQ, true);
     ttgo->power->clearIRQ();
 
+    // Configure touch interrupt
+    ttgo->touch->enableINT(); // Pulse interrupt for each new sample rather than whilst touched
+    pinMode(TOUCH_INT, INPUT);
+    attachInterrupt(TOUCH_INT, onTouchIrq, FALLING);
+
     // Configure accelerometer
     accel = ttgo->bma;
     Acfg cfg;
@@ -267,35 +683,161 @@ void setup(void)
     cfg.perf_mode = BMA4_CONTINUOUS_MODE;
     accel->accelConfig(cfg);
     accel->enableAccel();
+    // Gestures are detected by the sensor which interrupts on tilt (wrist turned to face), double tap (wakeup) and motion
+    accel->enableFeature(BMA423_TILT | BMA423_WAKEUP | BMA423_ANY_MOTION, true);
+    accel->enableTiltInterrupt();
+    accel->enableWakeupInterrupt();
+    accel->enableAnyNoMotionInterrupt();
+    pinMode(BMA423_INT1, INPUT);
+    attachInterrupt(BMA423_INT1, onAccelIrq, RISING);
+    for (uint8_t i = 0; i < 2; ++i)
+        tiltFilters[i].begin(TILT_RATE, 256, 66); // 1Hz cutoff when still, rising 1Hz per g/s
+    bootMark(BOOT_INPUT);
+
+#if CONFIG_PM_ENABLE
+    // Automatic light sleep needs tickless idle support in the SDK build
+    esp_pm_config_esp32_t pm = {POWER_CPU_MHZ[POWER_SLEEP], POWER_MIN_MHZ, true};
+    lightSleepAvailable = (esp_pm_configure(&pm) == ESP_OK);
+#endif
+    configureCpu(POWER_ACTIVE);
+    screenOn();
 
-    if (settings[SETTING_BLE])
-        startBle();
+    // BLE stack runs on PRO core so keep input and rendering on APP core
+    esp_register_freertos_idle_hook_for_cpu(onIdle, APP_CPU_NUM);
+    xTaskCreatePinnedToCore(inputTask, "input", 4096, nullptr, INPUT_TASK_PRIORITY, &inputTaskHandle, APP_CPU_NUM);
+    xTaskCreatePinnedToCore(midiTask, "midi", 4096, nullptr, MIDI_TASK_PRIORITY, &midiTaskHandle, PRO_CPU_NUM);
+    xTaskCreatePinnedToCore(renderTask, "render", 4096, nullptr, RENDER_TASK_PRIORITY, &renderTaskHandle, APP_CPU_NUM);
+    xTaskCreatePinnedToCore(storageTask, "storage", 4096, nullptr, STORAGE_TASK_PRIORITY, &storageTaskHandle, PRO_CPU_NUM);
+    bootMark(BOOT_TASKS);
+}
 
-    screenOn();
+// Record completion of a boot phase
+void bootMark(uint8_t phase) {
+    bootUs[phase] = micros() - bootStartUs;
+    bootDone |= 1 << phase;
+}
+
+// Print time each boot phase completed, from start of setup()
+void printBoot() {
+    Serial.printf("boot (ms): setup started at %u.%u, then", bootStartUs / 1000, bootStartUs / 100 % 10);
+    for (uint8_t i = 0; i < BOOT_COUNT; ++i) {
+        if (bootDone & (1 << i))
+            Serial.printf(" %s %u.%u", BOOT_NAMES[i], bootUs[i] / 1000, bootUs[i] / 100 % 10);
+        else
+            Serial.printf(" %s -", BOOT_NAMES[i]);
+    }
+    if (bootDone & (1 << BOOT_BLE))
+        Serial.printf(", advertising %s %ums target", bootUs[BOOT_BLE] / 1000 > BOOT_ADVERTISE_TARGET_MS ? "later than" : "within", BOOT_ADVERTISE_TARGET_MS);
+    Serial.printf("\n");
 }
 
 void loop()
 {
-    static uint32_t lastMs = 0;
-    static uint32_t nextRefresh = 0;
-    static uint32_t nextFlash = 0;
-    static uint32_t nextSecond = 0;
-    static uint32_t nextTenSecond = 0;
-    static uint32_t nextMinute = 0;
-    static uint32_t nextPulse = 0;
-    static uint32_t lastBtnPress = 0;
-    static uint32_t cycleCount = 0;
-    static bool btnPressed = false;
-    static bool blink = false;
+    // All work is done in tasks
+    vTaskDelete(nullptr);
+}
 
-    cycleCount++;
-    now = millis();
+// Idle hook - counts idle periods to calculate CPU load. Returning true lets the core wait for next interrupt.
+bool onIdle() {
+    ++idleCount;
+    return true;
+}
+
+// Touch controller has a new sample - record time and wake input task to read it
+void IRAM_ATTR onTouchIrq() {
+    touchIrqUs = esp_timer_get_time();
+    ++touchIrqCount;
+    wakeInput();
+}
+
+// Wake input task from interrupt
+void IRAM_ATTR onAccelIrq() {
+    accelIrq = true;
+    wakeInput();
+}
+
+void IRAM_ATTR wakeInput() {
+    if (sleepWakeArmed)
+        setSleepWake(false); // Level triggered wake would repeat until cause is cleared
+    BaseType_t woken = pdFALSE;
+    if (inputTaskHandle)
+        vTaskNotifyGiveFromISR(inputTaskHandle, &woken);
+    if (woken)
+        portYIELD_FROM_ISR();
+}
+
+// Lock UI state shared between tasks
+void lockUi() {
+    xSemaphoreTakeRecursive(uiMutex, portMAX_DELAY);
+}
+
+// Unlock UI state shared between tasks
+void unlockUi() {
+    xSemaphoreGiveRecursive(uiMutex);
+}
+
+// High priority task that handles power button, touch and accelerometer - woken by interrupts
+void inputTask(void* param) {
+    for (;;) {
+        // Touch interrupts wake task for each sample. Also wake to report release and to sample in case a touch interrupt is missed.
+        uint32_t timeout = touching ? TOUCH_POLL_MS : IDLE_POLL_MS;
+        uint32_t releaseUs = touchFilter.releaseDue(micros());
+        if (releaseUs && releaseUs / 1000 + 1 < timeout)
+            timeout = releaseUs / 1000 + 1;
+        if (tiltActive())
+            timeout = 1000 / TILT_RATE;
+        if (thinningPending && settings[SETTING_CCRATE] < timeout)
+            timeout = settings[SETTING_CCRATE] ? settings[SETTING_CCRATE] : 1; // Wake to send held controller values
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout));
+        processInput();
+    }
+}
+
+// Medium priority task that applies incoming MIDI messages and sends outgoing MIDI - woken by BLE callbacks and input task
+void midiTask(void* param) {
+    for (;;) {
+        TickType_t timeout = processMidi();
+        ulTaskNotifyTake(pdTRUE, timeout);
+    }
+}
+
+// Low priority task that updates display at 20Hz and handles housekeeping
+void renderTask(void* param) {
+    TickType_t lastWake = xTaskGetTickCount();
+    for (;;) {
+        if (standby) {
+            // Only housekeeping whilst display is off. screenOn() wakes task to draw.
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(STANDBY_RENDER_MS));
+            lastWake = xTaskGetTickCount();
+        } else {
+            vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(RENDER_MS));
+        }
+        processRender();
+    }
+}
 
+// Lowest priority task that writes settings and firmware updates to flash so that flash erase and write never delay UI or MIDI
+void storageTask(void* param) {
+    for (;;) {
+        processOta();
+        TickType_t timeout = processStorage();
+        ulTaskNotifyTake(pdTRUE, timeout);
+    }
+}
+
+void processInput() {
+    acquireTouch(); // I2C read without blocking UI
+    lockUi();
+    now = millis();
+    if (numPadClose && (int32_t)(now - numPadClose) >= 0) {
+        numPadClose = 0;
+        mode = MODE_SETTINGS;
+        numPad[10].setText("");
+    }
     if (irq) {
         ttgo->power->readIRQ();
         bool shortPress = ttgo->power->isPEKShortPressIRQ();
         bool longPress = ttgo->power->isPEKLongPressIRQ();
-        bool charging = ttgo->power->isChargeing();
         irq = false;
         ttgo->power->clearIRQ();
         if (longPress) {
@@ -315,76 +857,374 @@ void loop()
 
     processTouch();
     processAccel();
+    processTilt();
+    processThinning();
+    unlockUi();
+    // Messages generated during this pass are sent together
+    if (!midiTx.empty())
+        xTaskNotifyGive(midiTaskHandle);
+}
 
-    if (pulseRadius && (nextPulse < now))
-        nextPulse = now + 6;
-
-    if (lastMs != now) {
-        // 1mS (or slower)
-        cpuLoad = cycleCount;
-        cycleCount = 0;
-        if (nextRefresh < now) {
-            // Refresh rate = 20Hz
-            if (!standby)
-                refresh();
-            nextRefresh = now + 50;
-        }
-        if (nextFlash < now) {
-            nextFlash = now + 300;
-            flash = !flash;
-        }
-        if (nextSecond < now) {
-            nextSecond += 1000;
-            if (screenTimeout && (--screenTimeout == 0))
-                screenOff();
+// Queue outgoing MIDI message to be sent at next flush
+void sendMidi(uint8_t status, uint8_t data1, uint8_t data2) {
+    if (!settings[SETTING_BLE])
+        return;
+    midi_event_t ev = {};
+    ev.status = status;
+    ev.data1 = data1;
+    ev.data2 = data2;
+    ev.timestamp = millis();
+    ev.us = touchUs;
+    ev.due = 0; // Outgoing messages are sent at next flush
+    midiTx.push(ev);
+}
 
-            if (nextTenSecond < now) {
-                nextTenSecond = now + 10000;
-                battery = ttgo->power->getBattPercentage();
-                charging = ttgo->power->isChargeing();
+void sendNoteOn(uint8_t chan, uint8_t note, uint8_t vel) {
+    sendMidi(0x90 | (chan & 0x0F), note, vel);
+}
 
-                if (nextMinute < now) {
-                    nextMinute = now + 60000;
-                }
+void sendControlChange(uint8_t chan, uint8_t cc, uint8_t val) {
+    ccValues[chan & 0x0F][cc & 0x7F] = val;
+    sendMidi(0xB0 | (chan & 0x0F), cc, val);
+}
+
+// Send relative step for an encoder strip (0..3)
+void sendEncoderStep(uint8_t strip, int8_t step) {
+    sendNoteOn(15, 16 + strip * 2 + (step < 0 ? 0 : 1), 127);
+}
+
+// Get controller shown (and sent in absolute mode) by an encoder strip (0..3)
+uint8_t encoderCc(uint8_t strip) {
+    return profile->encCc[strip & 3];
+}
+
+// True if tilt controller is sampling accelerometer
+bool tiltActive() {
+    return mode == MODE_TILT && !menuShowing && !standby;
+}
+
+// Convert accelerometer reading of one axis to controller value, assuming gravity is the only force
+uint8_t tiltToCc(int32_t a) {
+    if (a < -TILT_ONE_G)
+        a = -TILT_ONE_G;
+    if (a > TILT_ONE_G)
+        a = TILT_ONE_G;
+    return (a + TILT_ONE_G) * 127 / (2 * TILT_ONE_G);
+}
+
+/*  Sample accelerometer for tilt controller at TILT_RATE
+    Wrist roll (X axis) and pitch (Y axis) are filtered and sent as X-CC and Y-CC when they change by at least TILT_THRESHOLD.
+*/
+void processTilt() {
+    static uint32_t nextSample = 0;
+    if (!tiltActive()) {
+        tiltFilters[0].reset();
+        tiltFilters[1].reset();
+        return;
+    }
+    if ((int32_t)(now - nextSample) < 0)
+        return;
+    nextSample = now + 1000 / TILT_RATE;
+    Accel acc;
+    if (!accel->getAccel(acc))
+        return;
+    uint8_t cc[2] = {
+        tiltToCc(tiltFilters[0].update(acc.x)),
+        tiltToCc(-tiltFilters[1].update(acc.y))
+    };
+    touchUs = micros(); // Accelerometer sample is the input sample for latency statistics
+    for (uint8_t i = 0; i < 2; ++i) {
+        if (!tiltThresholds[i].update(cc[i], TILT_THRESHOLD))
+            continue;
+        if (ccLimiters[i].update(cc[i], now, settings[SETTING_CCRATE]))
+            sendControlChange(profile->midiChan, (i ? profile->ccY : profile->ccX), cc[i]);
+    }
+    tilt_x = tiltThresholds[0].value() * 239 / 127;
+    tilt_y = 219 - tiltThresholds[1].value() * 219 / 127;
+}
+
+// Send controller values held back by rate limiters that are now due
+void processThinning() {
+    uint8_t window = settings[SETTING_CCRATE];
+    uint8_t val;
+    int8_t step;
+    if (ccLimiters[0].poll(now, window, val))
+        sendControlChange(profile->midiChan, profile->ccX, val);
+    if (ccLimiters[1].poll(now, window, val))
+        sendControlChange(profile->midiChan, profile->ccY, val);
+    thinningPending = ccLimiters[0].held() || ccLimiters[1].held();
+    for (uint8_t i = 0; i < 4; ++i) {
+        if (encLimiters[i].poll(now, window, step))
+            sendEncoderStep(i, step);
+        if (encCcLimiters[i].poll(now, window, val))
+            sendControlChange(profile->midiChan, encoderCc(i), val);
+        thinningPending |= encLimiters[i].held() || encCcLimiters[i].held();
+    }
+}
+
+// Send a BLE MIDI packet
+void notifyMidiPacket(BLECharacteristic* characteristic) {
+    if (midiPacket.empty())
+        return;
+    characteristic->setValue((uint8_t*)midiPacket.data(), midiPacket.size());
+    characteristic->notify();
+    ++txPackets;
+    txMessages += midiPacket.messages();
+    if (midiPacket.messages() > txMaxPerPacket)
+        txMaxPerPacket = midiPacket.messages();
+}
+
+// Send all queued outgoing MIDI messages in as few BLE MIDI packets as possible
+void flushMidi() {
+    midi_event_t events[MIDI_BATCH];
+    uint32_t count;
+    BLECharacteristic* characteristic = midiCharacteristic;
+    bool connected = characteristic && BLEMidiServer.isConnected();
+    lastTxFlush = millis();
+    midiPacket.begin(bleMtu - 3);
+    while ((count = midiTx.pop(events, MIDI_BATCH))) {
+        if (!connected)
+            continue; // Discard
+        for (uint32_t i = 0; i < count; ++i) {
+            midi_event_t& ev = events[i];
+            perf[PERF_TOUCH_TO_BLE].add(micros() - ev.us);
+            if (midiPacket.add(ev.timestamp, ev.status, ev.data1, ev.data2))
+                continue;
+            notifyMidiPacket(characteristic);
+            midiPacket.clear();
+            midiPacket.add(ev.timestamp, ev.status, ev.data1, ev.data2);
+        }
+    }
+    if (connected)
+        notifyMidiPacket(characteristic);
+}
+
+// Handle BLE GAP events to track connection interval
+void onGapEvent(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param) {
+    if (event == ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT) {
+        // Interval is in units of 1.25ms
+        uint16_t interval = param->update_conn_params.conn_int * 5 / 4;
+        bleConnInterval = interval ? interval : 1;
+    }
+}
+
+// Handle BLE GATT server events to track negotiated MTU and receive MIDI and firmware updates
+void onGattsEvent(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t* param) {
+    switch (event) {
+        case ESP_GATTS_MTU_EVT:
+            bleMtu = param->mtu.mtu;
+            break;
+        case ESP_GATTS_WRITE_EVT:
+            if (param->write.is_prep)
+                break;
+            // Incoming MIDI is decoded here rather than by BLE MIDI library to access all message types and timestamps
+            if (midiCharacteristic && param->write.handle == midiCharacteristic->getHandle()) {
+                onMidiPacket(param->write.value, param->write.len);
+            } else if (otaData && param->write.handle == otaData->getHandle()) {
+                onOtaWrite(OTA_DATA, param->write.value, param->write.len);
+            } else if (otaControl && param->write.handle == otaControl->getHandle() && param->write.len) {
+                memcpy(otaPeer, param->write.bda, sizeof(otaPeer));
+                onOtaWrite(param->write.value[0], param->write.value + 1, param->write.len - 1);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/*  Apply queued incoming MIDI messages that are due, in batches to limit time UI is locked, and send queued outgoing messages if due
+    Returns ticks until next incoming message or outgoing flush is due (portMAX_DELAY if nothing queued)
+*/
+uint32_t processMidi() {
+    uint32_t timeout = portMAX_DELAY;
+    midi_event_t ev;
+    while (midiRx.peek(ev)) {
+        lockUi();
+        now = millis();
+        for (uint8_t i = 0; i < MIDI_BATCH && midiRx.peek(ev); ++i) {
+            uint32_t us = micros();
+            int32_t wait = ev.due - us;
+            if (wait > 0) {
+                // Messages are queued in order sent so none behind this are due either
+                timeout = pdMS_TO_TICKS((wait + 999) / 1000);
+                break;
+            }
+            midiRx.pop(ev);
+            // Measure processing latency from when message could first be applied
+            uint32_t startUs = ev.due;
+            if ((int32_t)(ev.us - ev.due) > 0) {
+                ++rxLate;
+                startUs = ev.us;
+            }
+            perf[PERF_BLE_TO_UI].add(us - startUs);
+            perf[PERF_RX_JITTER].add(ev.us + BLE_MIDI_RX_LATENCY - ev.due);
+            midi_handler_t handler = midiHandlers[ev.status & 0x7F];
+            if (!handler)
+                continue;
+            if (ev.status < 0xF8 && !rxPixelUs)
+                rxPixelUs = startUs;
+            handler(ev);
+        }
+        unlockUi();
+        if (timeout != portMAX_DELAY)
+            break;
+    }
+
+    if (midiTx.empty())
+        return timeout;
+    // Send at most once per connection interval
+    uint32_t elapsed = millis() - lastTxFlush;
+    if (elapsed < bleConnInterval) {
+        uint32_t flush = pdMS_TO_TICKS(bleConnInterval - elapsed);
+        return flush < timeout ? flush : timeout;
+    }
+    flushMidi();
+    return timeout;
+}
+
+void processRender() {
+    static uint32_t nextSecond = 0;
+    static uint32_t nextTenSecond = 0;
+    static uint32_t nextMinute = 0;
+
+    if (!standby && displayAsleep) {
+        ttgo->displayWakeup();
+        displayAsleep = false;
+        vTaskDelay(pdMS_TO_TICKS(5)); // Panel ignores commands for 5ms after leaving sleep
+    }
+    lockUi();
+    now = millis();
+    applyBeats();
+    displayIdle(); // Close previous frame's display transaction
+    if (!standby) {
+        refresh();
+        if (backlightPending && displayIdle()) {
+            // Only show display after it has been drawn
+            ttgo->setBrightness(settings[SETTING_BRIGHTNESS]);
+            ttgo->openBL();
+            backlightPending = false;
+        }
+        if (!(bootDone & (1 << BOOT_FRAME))) {
+            bootMark(BOOT_FRAME);
+            // No internal heap should be used by the application after this point. Button tiles are allocated from PSRAM when each view is first drawn.
+            bootHeap = lowHeap = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+            printBoot();
+            confirmFirmware();
+        }
+    }
+    // Serial commands: p - print statistics, r - reset statistics
+    while (Serial.available()) {
+        switch (Serial.read()) {
+            case 'p':
+                dumpPerf();
+                break;
+            case 't':
+                touchTrace = !touchTrace;
+                break;
+            case 'r':
+                for (uint8_t i = 0; i < PERF_COUNT; ++i)
+                    perf[i].clear();
+                powerStats.clear(now);
+                break;
+        }
+    }
+    if (nextSecond < now) {
+        nextSecond += 1000;
+        if (screenTimeout) {
+            if (--screenTimeout == 0)
+                screenOff();
+            else if (screenTimeout == POWER_DIM_S)
+                setPowerState(POWER_DIMMED);
+        }
+        if (standby && offSeconds < 255 && ++offSeconds == POWER_SLEEP_S)
+            setPowerState(POWER_SLEEP);
+        // Idle hook is called about once per 1ms tick when core is idle
+        uint32_t idle = idleCount;
+        idleCount = 0;
+        cpuLoad = idle < 1000 ? 100 - idle / 10 : 0;
+        uint32_t heap = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+        if (heap < lowHeap)
+            lowHeap = heap;
+
+        if (nextTenSecond < now) {
+            nextTenSecond = now + 10000;
+            for (uint8_t i = 0; i < PERF_COUNT; ++i)
+                perf[i].roll();
+            battery = ttgo->power->getBattPercentage();
+            charging = ttgo->power->isChargeing();
+
+            if (nextMinute < now) {
+                nextMinute = now + 60000;
             }
-            blink = !blink;
         }
     }
-    lastMs = now;
+    unlockUi();
 }
 
 void updateNavigationButtons() {
     uint8_t offset = (mode == MODE_NAVIGATE1) ? 0 : 9;
     for (uint8_t i = 0; i < 9; ++i) {
         uint8_t id = BTN_IDS[i + offset];
-        navigationBtns[i]->setText(BTN_LABELS[id]);
-        navigationBtns[i]->m_mode = id;
+        navigationBtns[i].setText(BTN_LABELS[id]);
+        navigationBtns[i].m_mode = id;
     }
 }
 
+/*  Read touch controller and queue timestamped sample. Call without UI locked.
+    Controller is read when its interrupt signals a new sample, or periodically whilst touched in case an interrupt is missed.
+*/
+void acquireTouch() {
+    uint32_t irqCount = touchIrqCount;
+    uint32_t us = micros();
+    if (irqCount == touchIrqRead && !(touchFilter.down() && us - touchSampleUs >= TOUCH_POLL_MS * 1000))
+        return;
+    touch_sample_t sample;
+    sample.us = irqCount == touchIrqRead ? us : touchIrqUs;
+    touchIrqRead = irqCount;
+    touchSampleUs = us;
+    sample.down = ttgo->getTouch(sample.x, sample.y);
+    touchRing.push(sample);
+    if (!touchTrace)
+        return;
+    // Trace lines can be replayed by simulator
+    if (sample.down)
+        Serial.printf("%u %d %d\n", sample.us, sample.x, sample.y);
+    else
+        Serial.printf("%u -\n", sample.us);
+}
+
+// Debounce queued touch samples and apply resulting touch events
 void processTouch() {
-    static uint32_t touchTime = 0, releaseTime = 0, lastUpdateTime = 0;
+    touch_sample_t sample;
+    while (touchRing.pop(sample)) {
+        touch_event_t ev = touchFilter.update(sample);
+        if (ev.type != TOUCH_NONE)
+            onTouchEvent(ev);
+    }
+    touch_event_t ev = touchFilter.poll(micros());
+    if (ev.type != TOUCH_NONE)
+        onTouchEvent(ev);
+}
+
+void onTouchEvent(const touch_event_t& ev) {
     static int16_t x, y, startX, startY, lastX, lastY;
     static uint8_t last_cc_x, last_cc_y;
     static bool scrolling = false;
     uint8_t cc_x, cc_y;
 
-    if (ttgo->getTouch(x, y)) {
+    if (ev.type != TOUCH_UP) {
+        x = ev.x;
+        y = ev.y;
+        touchUs = ev.us;
         screenOn();
-        if (!touching) {
-            if (now > touchTime + 100) {
-                // First touch debounced
-                startX = lastX = x;
-                startY = lastY = y;
-                touchTime = now;
-                touching = true;
-                topDrag = 0;
-                bottomDrag = 240;
-                leftDrag = 0;
-                rightDrag = 240;
-            } else {
-                return;
-            }
+        if (ev.type == TOUCH_DOWN) {
+            startX = lastX = x;
+            startY = lastY = y;
+            touching = true;
+            topDrag = 0;
+            bottomDrag = 240;
+            leftDrag = 0;
+            rightDrag = 240;
         }
         // Touched / dragging
         if (startY < 20 && mode != MODE_XY && !menuShowing) {
@@ -405,8 +1245,8 @@ void processTouch() {
             return;
         }
         if (menuShowing) {
-            for (uint8_t i = 0; i < 5; ++i) {
-                gfxButton* btn = menuBtns[i];
+            for (uint8_t i = 0; i < 7; ++i) {
+                gfxButton* btn = &menuBtns[i];
                 if (btn->bounds(x, y - 20)) {
                     selPad = i;
                     break;
@@ -416,18 +1256,24 @@ void processTouch() {
             switch(mode) {
                 case MODE_ENCODERS:
                     {
+                        uint8_t strip = x < 240 ? x / 60 : 3;
+                        if (profile->encMode) {
+                            // Absolute - value from touch position on strip
+                            uint8_t val = y > 20 ? (240 - y) * 127 / 220 : 127;
+                            uint8_t* value = &ccValues[profile->midiChan][encoderCc(strip)];
+                            if (val == *value)
+                                break;
+                            *value = val;
+                            if (encCcLimiters[strip].update(val, now, settings[SETTING_CCRATE]))
+                                sendControlChange(profile->midiChan, encoderCc(strip), val);
+                            break;
+                        }
                         int16_t dY = startY - y;
                         if (dY < 1 && dY > -1)
                             break;
-                        uint8_t val = 127 * (240 - y + 20) / 220;
-                        if (x < 60)
-                            BLEMidiServer.noteOn(15, dY<0?16:17, 127);
-                        else if (x < 120)
-                            BLEMidiServer.noteOn(15, dY<0?18:19, 127);
-                        else if (x < 180)
-                            BLEMidiServer.noteOn(15, dY<0?20:21, 127);
-                        else
-                            BLEMidiServer.noteOn(15, dY<0?22:23, 127);
+                        int8_t step = dY < 0 ? -1 : 1;
+                        if (encLimiters[strip].update(step, now, settings[SETTING_CCRATE]))
+                            sendEncoderStep(strip, step);
                         startY = y;
                     }
                     break;
@@ -438,14 +1284,14 @@ void processTouch() {
                     else
                         cc_y = 0;
                     if (cc_x != last_cc_x) {
-                        if (settings[SETTING_BLE])
-                            BLEMidiServer.controlChange(settings[SETTING_MIDICHAN], settings[SETTING_CCX], cc_x);
+                        if (ccLimiters[0].update(cc_x, now, settings[SETTING_CCRATE]))
+                            sendControlChange(profile->midiChan, profile->ccX, cc_x);
                         last_cc_x = cc_x;
                         crosshair_x = x;
                     }
                     if (cc_y != last_cc_y) {
-                        if (settings[SETTING_BLE])
-                            BLEMidiServer.controlChange(settings[SETTING_MIDICHAN], settings[SETTING_CCY], cc_y);
+                        if (ccLimiters[1].update(cc_y, now, settings[SETTING_CCRATE]))
+                            sendControlChange(profile->midiChan, profile->ccY, cc_y);
                         last_cc_y = cc_y;
                         if (y > 20)
                             crosshair_y = y - 20;
@@ -459,8 +1305,8 @@ void processTouch() {
                     if (pad < 16) {
                         if (pad != selPad) {
                             if (selPad < 16)
-                                BLEMidiServer.noteOn(settings[SETTING_MIDICHAN], selPad, 0);
-                            BLEMidiServer.noteOn(settings[SETTING_MIDICHAN], pad, 100);
+                                sendNoteOn(profile->midiChan, profile->padNotes[selPad], 0);
+                            sendNoteOn(profile->midiChan, profile->padNotes[pad], 100);
                             selPad = pad;
                         }
                     }
@@ -472,23 +1318,25 @@ void processTouch() {
                     if (selPad != 255)
                         break; // Don't allow slide between buttons
                     for (uint8_t i = 0; i < 9; ++i) {
-                        gfxButton* btn = navigationBtns[i];
+                        gfxButton* btn = &navigationBtns[i];
                         if (!btn->bounds(x, y - 20))
                             continue;
                         selPad = btn->getMode();
                         if (selPad < 20)
-                            BLEMidiServer.noteOn(15, selPad + 94, 100);
+                            sendNoteOn(15, profile->navNotes[selPad], 100);
                         break;
                     }
                     break;
                 }
                 case MODE_SETTINGS:
                 {
-                    if (settingsBtns[SETTING_BRIGHTNESS]->bounds(x, y - 20)) {
+                    if (ev.type == TOUCH_DOWN && settingsList.press())
+                        scrolling = true; // Touch stops fling rather than selecting a row
+                    if (settingsList.rowAt(y - 20) == SETTING_BRIGHTNESS && settingsBtns[SETTING_BRIGHTNESS].bounds(x, y - 20)) {
                         int16_t dX = x - startX;
                         if (dX > 5 || dX < -5) {
                             // A bit of hysteresis
-                            int16_t val = (x - settingsBtns[SETTING_BRIGHTNESS]->m_x) * 255 / settingsBtns[SETTING_BRIGHTNESS]->m_w;
+                            int16_t val = (x - settingsBtns[SETTING_BRIGHTNESS].m_x) * 255 / settingsBtns[SETTING_BRIGHTNESS].width();
                             settings[SETTING_BRIGHTNESS] = val;
                             ttgo->setBrightness(val);
                             startX = x;
@@ -499,11 +1347,7 @@ void processTouch() {
                         if (dY > 10 || dY < -10)
                             scrolling = true;
                     } else {
-                        settingsOffset += (startY - y);
-                        if (settingsOffset < 0)
-                            settingsOffset = 0;
-                        if (settingsOffset > (settingsSize - 4) * 54)
-                            settingsOffset = (settingsSize - 4) * 54;
+                        settingsList.drag(startY - y, ev.us);
                         startY = y;
                     }
                     break;
@@ -512,15 +1356,14 @@ void processTouch() {
         }
         lastX = x;
         lastY = y;
-    } else if(touching) {
+    } else {
         // Release
-        if (touchTime + 200 > now)
-            return; // debounce
-        releaseTime = now;
         touching = false;
         if (topDrag) {
             if (topDrag > 120)
                 menuShowing = true;
+            else if (topDrag < 20)
+                perfOverlay = !perfOverlay; // Tap on status bar
             topDrag = 0;
             return;
         } else if (bottomDrag < 240) {
@@ -535,22 +1378,25 @@ void processTouch() {
             updateNavigationButtons();
             return;
         } else if (rightDrag < 240) {
-            if (rightDrag < 120)
+            if (rightDrag < 120) {
                 if (mode > MODE_SETTINGS)
                     mode = MODE_SETTINGS;
                 else if (++mode > MODE_SETTINGS)
                     mode = MODE_NAVIGATE1;
+            }
             rightDrag = 240;
             updateNavigationButtons();
             return;
         }
         if (scrolling) {
             scrolling = false;
+            if (mode == MODE_SETTINGS)
+                settingsList.release(ev.us);
             return;
         }
         if (menuShowing) {
-            if (selPad < 5) {
-                mode = menuBtns[selPad]->getMode();
+            if (selPad < 7) {
+                mode = menuBtns[selPad].getMode();
                 updateNavigationButtons();
                 menuShowing = false;
             }
@@ -560,13 +1406,13 @@ void processTouch() {
                     break;
                 case MODE_PADS:
                     if (selPad < 16)
-                        BLEMidiServer.noteOn(settings[SETTING_MIDICHAN], selPad, 0);
+                        sendNoteOn(profile->midiChan, profile->padNotes[selPad], 0);
                     selPad = -1;
                     break;
                 case MODE_NAVIGATE1:
                 case MODE_NAVIGATE2:
                     if (selPad < 20) {
-                        BLEMidiServer.noteOn(15, selPad + 94, 0);
+                        sendNoteOn(15, profile->navNotes[selPad], 0);
                     } else {
                         mode = mode==MODE_NAVIGATE1?MODE_NAVIGATE2:MODE_NAVIGATE1;
                         updateNavigationButtons();
@@ -578,9 +1424,11 @@ void processTouch() {
                 case MODE_CCY:
                 case MODE_METROHIGH:
                 case MODE_METROLOW:
+                case MODE_CCRATE:
+                case MODE_ENCCC:
                     // Handle keypad release
                     for (uint8_t i = 0; i < 11; ++i) {
-                        gfxButton* btn = numPad[i];
+                        gfxButton* btn = &numPad[i];
                         if (!btn->bounds(x, y - 20))
                             continue;
                         oskSel = btn->getMode();
@@ -588,9 +1436,19 @@ void processTouch() {
                         break;
                     }
                     break;
+                case MODE_PROFILE:
+                    for (uint8_t i = 0; i < PROFILE_COUNT; ++i) {
+                        if (!profileBtns[i].bounds(x, y - 20))
+                            continue;
+                        selectProfile(i);
+                        selPad = 255;
+                        menuShowing = true;
+                        break;
+                    }
+                    break;
                 case MODE_TIMEOUT:
                     for (uint8_t i = 0; i < 8; ++i) {
-                        gfxButton* btn = sleepBtns[i];
+                        gfxButton* btn = &sleepBtns[i];
                         if (!btn->bounds(x, y - 20))
                             continue;
                         if (btn->getMode() != 255) {
@@ -601,21 +1459,26 @@ void processTouch() {
                     }
                     break;
                 case MODE_SETTINGS:
+                {
                     // Handle settings menu release
-                    for (uint8_t i = 0; i < settingsSize; ++i) {
-                        gfxButton* btn = settingsBtns[i];
-                        if (!btn->bounds(x, y - 20))
-                            continue;
-                        mode = btn->getMode();
-                        if (mode == MODE_BLE) {
-                            toggleBle();
-                            mode = MODE_SETTINGS;
-                        } else if (mode == MODE_BRIGHTNESS) {
-                            mode = MODE_SETTINGS;
-                        }
+                    int16_t row = settingsList.rowAt(y - 20);
+                    if (row < 0 || !settingsBtns[row].bounds(x, y - 20))
                         break;
+                    mode = settingsBtns[row].getMode();
+                    if (mode == MODE_BLE) {
+                        toggleBle();
+                        mode = MODE_SETTINGS;
+                    } else if (mode == MODE_ENCMODE) {
+                        profile->encMode = !profile->encMode;
+                        mode = MODE_SETTINGS;
+                    } else if (mode == MODE_OTA) {
+                        settings[SETTING_OTA] = !settings[SETTING_OTA];
+                        mode = MODE_SETTINGS;
+                    } else if (mode == MODE_BRIGHTNESS) {
+                        mode = MODE_SETTINGS;
                     }
                     break;
+                }
             }
         }
     oskSel = MODE_NONE;
@@ -623,107 +1486,472 @@ void processTouch() {
 }
 
 
-bool processAccel() {
-    static uint8_t prevRotation = 0;
-    Accel acc;
-    uint8_t rotation = accel->direction();
-    if (prevRotation != rotation) {
-        screenOn();
-        prevRotation = rotation;
-        switch (rotation) {
-            case DIRECTION_DISP_DOWN:
-                break;
-            case DIRECTION_DISP_UP:
-                break;
-            case DIRECTION_BOTTOM_EDGE:
-                break;
-            case DIRECTION_TOP_EDGE:
-                break;
-            case DIRECTION_RIGHT_EDGE:
-                break;
-            case DIRECTION_LEFT_EDGE:
-                break;
-            default:
-                break;
-            }
+/*  Handle accelerometer interrupt
+    Sensor is only read after it raises an interrupt so there is no I2C traffic whilst still.
+    Orientation is checked after motion to detect display turned face up / down.
+*/
+void processAccel() {
+    static uint8_t prevRotation = DIRECTION_DISP_UP;
+    if (!accelIrq)
+        return;
+    accelIrq = false;
+    for (uint8_t retry = 0; retry < 3 && !accel->readInterrupt(); ++retry)
+        ;
+    if (accel->isTilt())
+        onGesture(GESTURE_TILT);
+    if (accel->isDoubleClick())
+        onGesture(GESTURE_DOUBLE_TAP);
+    if (accel->isAnyNoMotion()) {
+        uint8_t rotation = accel->direction();
+        if (rotation != prevRotation) {
+            prevRotation = rotation;
+            screenOn();
+            if (rotation == DIRECTION_DISP_UP)
+                onGesture(GESTURE_FACE_UP);
+            else if (rotation == DIRECTION_DISP_DOWN)
+                onGesture(GESTURE_FACE_DOWN);
+        }
     }
+}
 
-    if (accel->getAccel(acc)) {
-        /*
-        sprite->setCursor(40, 100);
-        sprite->printf("%03d, %03d, %03d", acc.x, acc.y, acc.z);
-        */
-        return true;
-    } else
-        return false;
+// Wake display and send gesture's MIDI message
+void onGesture(uint8_t gesture) {
+    const gesture_map_t& map = GESTURE_MAP[gesture];
+    if (gesture == GESTURE_TILT || gesture == GESTURE_DOUBLE_TAP)
+        screenOn();
+    if (!map.status)
+        return;
+    touchUs = micros(); // Gesture is the input sample for latency statistics
+    sendMidi(map.status | (profile->midiChan), map.data1, map.data2);
 }
 
 void onBleConnect() {
 }
 
 void onBleDisconnect() {
+    // Next connection renegotiates these
+    bleConnInterval = MIDI_TX_INTERVAL;
+    bleMtu = 23;
+    midiDecoder.reset();
+    rxTimebase.reset();
 }
 
-void onMidiCC(uint8_t chan, uint8_t cc, uint8_t val, uint16_t timestamp) {
+/*  Queue firmware update command or data write for storage task. Called from BLE stack so flash is not written here.
+    A data write dropped because the queue is full is detected by the storage task as a gap in offsets.
+*/
+void onOtaWrite(uint8_t type, const uint8_t* data, uint16_t len) {
+    static ota_rx_t rx; // Only called from BLE stack task
+    rx.type = type;
+    rx.offset = 0;
+    if (type == OTA_DATA) {
+        if (len <= OTA_DATA_HEADER)
+            return;
+        rx.offset = otaGet32(data);
+        data += OTA_DATA_HEADER;
+        len -= OTA_DATA_HEADER;
+    }
+    if (len > OTA_CHUNK_MAX)
+        return;
+    rx.len = len;
+    memcpy(rx.data, data, len);
+    otaRx.push(rx);
+    if (storageTaskHandle)
+        xTaskNotifyGive(storageTaskHandle);
 }
 
-void onMidiNoteOn(uint8_t chan, uint8_t note, uint8_t vel, uint16_t timestamp) {
-    // Note-on sets pad colour. Note number = pad (0..15). Velocity = colour (0..29).
-    if (chan != settings[SETTING_MIDICHAN])
-        return;
-    if (note < 16) {
-        if (vel == 0)
-            launchPads[note]->setText("");
-        if (vel < 4) {
-            launchPads[note]->m_bg = PAD_COLOURS[vel];
-            launchPads[note]->setText("");
-            padFlashing[note] = 0;
-        } else if (vel < 30) {
-            launchPads[note]->m_bg = PAD_COLOURS[vel];
-            launchPads[note]->setText("\x8A");
-            padFlashing[note] = 0;
-        } else if (vel < 34) {
-            launchPads[note]->m_bg = PAD_COLOURS[vel - 30];
-            //launchPads[note]->setText("");
-            padFlashing[note] = 1;
-        } else if (vel < 60) {
-            // Flashing
-            launchPads[note]->m_bg = PAD_COLOURS[vel - 30];
-            padFlashing[note] = 1;
-        } else if (vel < 64) {
-            launchPads[note]->m_bg = PAD_COLOURS[vel - 60];
-            padFlashing[note] = 1;
-        } else if (vel < 90) {
+// Decode incoming BLE MIDI packet. Called from BLE stack so pass messages to MIDI task rather than touching UI here.
+void onMidiPacket(const uint8_t* data, uint16_t len) {
+    midiDecoder.decode(data, len, onMidiMessage, onMidiSysex);
+    if (!midiRx.empty() && midiTaskHandle)
+        xTaskNotifyGive(midiTaskHandle);
+}
+
+// Queue decoded message to be applied a fixed latency after the sender's timestamp so that delivery jitter is removed
+void onMidiMessage(uint8_t status, uint8_t data1, uint8_t data2, uint16_t timestamp) {
+    uint32_t us = micros();
+    midiRx.push({status, data1, data2, timestamp, us, rxTimebase.map(timestamp, us) + BLE_MIDI_RX_LATENCY});
+}
+
+// Queue SysEx body then a 0xF0 message holding its sequence number so that it is handled in order with other messages
+void onMidiSysex(const uint8_t* data, uint8_t len, uint16_t timestamp) {
+    sysex_t msg;
+    msg.seq = sysexSeq++ & 0x7F;
+    msg.len = len;
+    memcpy(msg.data, data, len);
+    if (sysexRx.push(msg))
+        onMidiMessage(0xF0, msg.seq, 0, timestamp);
+}
+
+// Bind incoming MIDI handlers for channel messages on the configured MIDI channel and for system messages. Call with UI locked.
+void bindMidiHandlers() {
+    uint8_t chan = profile->midiChan;
+    memset(midiHandlers, 0, sizeof(midiHandlers));
+    for (uint8_t i = 0; i < 16; ++i)
+        midiHandlers[(0xB0 | i) & 0x7F] = storeControlChange;
+    midiHandlers[(0x80 | chan) & 0x7F] = handleNoteOff;
+    midiHandlers[(0x90 | chan) & 0x7F] = handleNoteOn;
+    midiHandlers[(0xB0 | chan) & 0x7F] = handleControlChange;
+    midiHandlers[(0xC0 | chan) & 0x7F] = handleProgramChange;
+    midiHandlers[(0xC0 | PROFILE_PC_CHAN) & 0x7F] = handleProgramChange;
+    midiHandlers[0xF0 & 0x7F] = handleSysex;
+    midiHandlers[0xF2 & 0x7F] = handleClock;
+    midiHandlers[0xF8 & 0x7F] = handleClock;
+    midiHandlers[0xFA & 0x7F] = handleClock;
+    midiHandlers[0xFB & 0x7F] = handleClock;
+    midiHandlers[0xFC & 0x7F] = handleClock;
+}
+
+// Arm beat timer for next beat using latest tempo estimate. Call with clockMutex held.
+void armBeatTimer() {
+    esp_timer_stop(beatTimer);
+    int32_t delay = (int32_t)(clockPll.tickTime(nextBeat) - (uint32_t)esp_timer_get_time());
+    esp_timer_start_once(beatTimer, delay > 0 ? delay : 0);
+}
+
+/*  Handle MIDI clock, start, continue, stop and song position pointer
+    Clock is timed by its scheduled time (sender time plus fixed latency).
+    Each clock refines the predicted time of the next beat so the metronome runs from the tempo estimate rather than directly from (bursty) BLE delivery.
+*/
+void handleClock(const midi_event_t& ev) {
+    xSemaphoreTake(clockMutex, portMAX_DELAY);
+    switch (ev.status) {
+        case 0xF8:
+            clockPll.tick(ev.due);
+            if (clockPll.running() && clockPll.locked(ev.due)) {
+                if (nextBeat < 0)
+                    nextBeat = (clockPll.position() + CLOCK_PPQN - 1) / CLOCK_PPQN * CLOCK_PPQN; // First beat at or after this clock
+                armBeatTimer();
+            }
+            break;
+        case 0xFA:
+            clockPll.start();
+            nextBeat = -1;
+            esp_timer_stop(beatTimer);
+            break;
+        case 0xFB:
+            clockPll.resume();
+            break;
+        case 0xFC:
+            clockPll.stop();
+            nextBeat = -1;
+            esp_timer_stop(beatTimer);
+            break;
+        case 0xF2:
+            // Next beat is found from new position on next clock
+            clockPll.setPosition(ev.data1 | (ev.data2 << 7));
+            nextBeat = -1;
+            esp_timer_stop(beatTimer);
+            break;
+    }
+    xSemaphoreGive(clockMutex);
+}
+
+// Metronome beat - called by esp_timer task
+void onBeatTimer(void* arg) {
+    xSemaphoreTake(clockMutex, portMAX_DELAY);
+    if (nextBeat < 0) {
+        xSemaphoreGive(clockMutex);
+        return; // Cancelled whilst firing
+    }
+    uint8_t beat = nextBeat / CLOCK_PPQN % BEATS_PER_BAR;
+    uint32_t period = clockPll.period() * CLOCK_PPQN;
+    nextBeat += CLOCK_PPQN;
+    // Keep time from tempo estimate whilst clocks are delayed but stop if clock is lost
+    if (clockPll.running() && clockPll.locked(esp_timer_get_time()))
+        armBeatTimer();
+    else
+        nextBeat = -1;
+    xSemaphoreGive(clockMutex);
+
+    ttgo->motor->onec(beat ? METRO_LOW_MS : METRO_HIGH_MS);
+    beatRx.push({beat, millis(), period / 1000});
+}
+
+// True if between MIDI Start / Continue and Stop - clock state is shared with beat timer
+bool clockRunning() {
+    xSemaphoreTake(clockMutex, portMAX_DELAY);
+    bool running = clockPll.running();
+    xSemaphoreGive(clockMutex);
+    return running;
+}
+
+// Show metronome beats passed from beat timer - called by render task with uiMutex held
+void applyBeats() {
+    beat_t ev;
+    while (beatRx.pop(ev)) {
+        pulseRadius = ev.beat ? 64 : 127;
+        // Lock pad animation to beat
+        beatStart = ev.start;
+        if (ev.period)
+            beatPeriod = ev.period;
+    }
+}
+
+// Precompute pulse brightness ramp of each pad colour, from 1/4 to full brightness
+void buildPadRamps() {
+    for (uint8_t i = 0; i < sizeof(PAD_COLOURS) / sizeof(PAD_COLOURS[0]); ++i) {
+        uint16_t colour = PAD_COLOURS[i];
+        for (uint8_t level = 0; level < PAD_RAMP_STEPS; ++level) {
+            uint16_t scale = 64 + 192 * level / (PAD_RAMP_STEPS - 1); // /256
+            uint16_t r = ((colour >> 11) & 0x1F) * scale >> 8;
+            uint16_t g = ((colour >> 5) & 0x3F) * scale >> 8;
+            uint16_t b = (colour & 0x1F) * scale >> 8;
+            padRamps[i][level] = (r << 11) | (g << 5) | b;
+        }
+    }
+}
+
+// Get position within current beat (0..255) used to animate pads
+uint8_t beatPhase() {
+    return (now - beatStart) % beatPeriod * 256 / beatPeriod;
+}
+
+void handleNoteOn(const midi_event_t& ev) {
+    // Note-on sets pad colour. Note mapped to pad by active profile. Velocity = colour (0..29).
+    uint8_t note = ev.data1;
+    uint8_t vel = ev.data2;
+    uint8_t pad = profile->padForNote(note);
+    if (pad != PROFILE_NO_PAD) {
+        if (vel == 0)
+            launchPads[pad].setText("");
+        if (vel < 4) {
+            padColour[pad] = vel;
+            launchPads[pad].setBg(PAD_COLOURS[padColour[pad]]);
+            launchPads[pad].setText("");
+            padFlashing[pad] = 0;
+        } else if (vel < 30) {
+            padColour[pad] = vel;
+            launchPads[pad].setBg(PAD_COLOURS[padColour[pad]]);
+            launchPads[pad].setText("\x8A");
+            padFlashing[pad] = 0;
+        } else if (vel < 34) {
+            padColour[pad] = vel - 30;
+            launchPads[pad].setBg(PAD_COLOURS[padColour[pad]]);
+            //launchPads[pad].setText("");
+            padFlashing[pad] = 1;
+        } else if (vel < 60) {
+            // Flashing
+            padColour[pad] = vel - 30;
+            launchPads[pad].setBg(PAD_COLOURS[padColour[pad]]);
+            padFlashing[pad] = 1;
+        } else if (vel < 64) {
+            padColour[pad] = vel - 60;
+            launchPads[pad].setBg(PAD_COLOURS[padColour[pad]]);
+            padFlashing[pad] = 1;
+        } else if (vel < 90) {
             // Pulsing
-            launchPads[note]->m_bg = PAD_COLOURS[vel - 60];
-            launchPads[note]->setText("\x8B");
-            padFlashing[note] = 2;
+            padColour[pad] = vel - 60;
+            launchPads[pad].setBg(PAD_COLOURS[padColour[pad]]);
+            launchPads[pad].setText("\x8B");
+            padFlashing[pad] = 2;
         }
-    } else if (note == settings[SETTING_METROHIGH]) {
+    } else if (clockRunning()) {
+        // Internal metronome is running from MIDI clock
+    } else if (note == profile->metroHigh) {
         ttgo->motor->onec(200 * vel / 127);
         pulseRadius = vel;
-    } else if (note == settings[SETTING_METROLOW]) {
+    } else if (note == profile->metroLow) {
         ttgo->motor->onec(200 * vel / 127);
         pulseRadius = vel;
     }
     screenOn();
 }
 
+// Controller on other channels is stored in case channel is changed
+void storeControlChange(const midi_event_t& ev) {
+    ccValues[ev.status & 0x0F][ev.data1] = ev.data2;
+}
+
+// Note-off clears pad, as note-on with zero velocity
+void handleNoteOff(const midi_event_t& ev) {
+    if (profile->padForNote(ev.data1) == PROFILE_NO_PAD)
+        return;
+    midi_event_t off = ev;
+    off.data2 = 0;
+    handleNoteOn(off);
+}
+
+/*  Controller on configured channel is stored for display on encoder strips
+    Controller configured as X-Y controller X axis vibrates and pulses X-Y view by its value
+*/
+void handleControlChange(const midi_event_t& ev) {
+    ccValues[ev.status & 0x0F][ev.data1] = ev.data2;
+    if (ev.data1 != profile->ccX)
+        return;
+    if (ev.data2)
+        ttgo->motor->onec(200 * ev.data2 / 127);
+    pulseRadius = ev.data2;
+    screenOn();
+}
+
+// Program change selects profile
+void handleProgramChange(const midi_event_t& ev) {
+    selectProfile(ev.data1);
+}
+
+// Apply SysEx message addressed to riband
+void handleSysex(const midi_event_t& ev) {
+    sysex_t msg;
+    do {
+        if (!sysexRx.pop(msg))
+            return;
+    } while (msg.seq != ev.data1); // Discard any body whose 0xF0 message was lost to a full queue
+    if (msg.len < 3 || msg.data[0] != SYSEX_ID)
+        return;
+    switch (msg.data[1]) {
+        case SYSEX_PAD_LABEL:
+            if (msg.data[2] < 16) {
+                char label[BTN_TEXT_SIZE];
+                uint8_t len = msg.len - 3 < BTN_TEXT_SIZE - 1 ? msg.len - 3 : BTN_TEXT_SIZE - 1;
+                memcpy(label, msg.data + 3, len);
+                label[len] = 0;
+                launchPads[msg.data[2]].setText(label);
+            }
+            break;
+        case SYSEX_PROFILE_NAME:
+        case SYSEX_PROFILE_PADS:
+        case SYSEX_PROFILE_NAV:
+        case SYSEX_PROFILE_ENC:
+            if (msg.data[2] < PROFILE_COUNT)
+                setProfileData(msg.data[2], msg.data[1], msg.data + 3, msg.len - 3);
+            break;
+    }
+}
+
+// Set part of a profile definition from SysEx data (7-bit values)
+void setProfileData(uint8_t index, uint8_t cmd, const uint8_t* data, uint8_t len) {
+    Profile& p = profiles[index];
+    uint8_t* dst;
+    uint8_t size;
+    switch (cmd) {
+        case SYSEX_PROFILE_NAME:
+            memset(p.name, 0, PROFILE_NAME_SIZE);
+            dst = (uint8_t*)p.name;
+            size = PROFILE_NAME_SIZE - 1;
+            break;
+        case SYSEX_PROFILE_PADS:
+            dst = p.padNotes;
+            size = PROFILE_PADS;
+            break;
+        case SYSEX_PROFILE_NAV:
+            dst = p.navNotes;
+            size = PROFILE_NAV_BUTTONS;
+            break;
+        case SYSEX_PROFILE_ENC:
+            dst = p.encCc;
+            size = PROFILE_ENCODERS;
+            break;
+        default:
+            return;
+    }
+    memcpy(dst, data, len < size ? len : size);
+    p.compile();
+    profileBtns[index].setText(p.name);
+    if (&p == profile)
+        menuBtns[6].setText(p.name);
+    saveProfile(index);
+}
+
+// Make a profile active. Call with UI locked.
+void selectProfile(uint8_t index) {
+    if (index >= PROFILE_COUNT || profile == &profiles[index])
+        return;
+    profile = &profiles[index];
+    settings[SETTING_PROFILE] = index;
+    bindMidiHandlers();
+    menuBtns[6].setText(profile->name);
+    redrawAll = true;
+    saveSettings();
+}
+
 void screenOn() {
     screenTimeout = settings[SETTING_TIMEOUT];
+    setPowerState(POWER_ACTIVE);
     if (!standby)
         return;
     standby = false;
-    refresh();
-    ttgo->openBL();
+    redrawAll = true;
+    backlightPending = true; // Render task switches on backlight after drawing
+    if (renderTaskHandle)
+        xTaskNotifyGive(renderTaskHandle);
 }
 
 void screenOff() {
     if (standby)
         return;
     standby = true;
-    ttgo->closeBL();
+    backlightPending = false;
     screenTimeout = 0;
+    offSeconds = 0;
+    setPowerState(POWER_OFF);
+}
+
+/*  Change power state
+    Display off puts panel to sleep and touch controller into monitor mode (it wakes itself when touched). Display is woken by render task.
+    Light sleep lets the CPU sleep whenever idle. BLE controller keeps the connection and wakes CPU for events, as do timers and input interrupts.
+*/
+void setPowerState(uint8_t state) {
+    if (state == powerState)
+        return;
+    uint8_t last = powerState;
+    powerState = state;
+    powerStats.enter(state, millis());
+    if (last == POWER_SLEEP)
+        setSleepWake(false);
+    configureCpu(state);
+    switch (state) {
+        case POWER_ACTIVE:
+            if (last == POWER_DIMMED)
+                ttgo->setBrightness(settings[SETTING_BRIGHTNESS]);
+            break;
+        case POWER_DIMMED:
+            ttgo->setBrightness(settings[SETTING_BRIGHTNESS] / POWER_DIM_DIV);
+            break;
+        case POWER_OFF:
+            if (last > POWER_DIMMED)
+                break;
+            displayWait();
+            ttgo->closeBL();
+            ttgo->displaySleep();
+            ttgo->touchToMonitor();
+            displayAsleep = true;
+            break;
+        case POWER_SLEEP:
+            setSleepWake(true);
+            break;
+    }
+}
+
+// Set CPU clock range for power state, using dynamic frequency scaling and light sleep if available
+void configureCpu(uint8_t state) {
+#if CONFIG_PM_ENABLE
+    esp_pm_config_esp32_t pm = {POWER_CPU_MHZ[state], POWER_MIN_MHZ, state == POWER_SLEEP && lightSleepAvailable};
+    if (esp_pm_configure(&pm) == ESP_OK)
+        return;
+#endif
+    setCpuFrequencyMhz(POWER_CPU_MHZ[state]);
+}
+
+/*  Enable or disable wake from light sleep by input interrupt lines
+    GPIO wake is level triggered so lines revert to edge triggered interrupts when disabled, which the first interrupt after waking does.
+*/
+void IRAM_ATTR setSleepWake(bool enable) {
+    portENTER_CRITICAL_SAFE(&sleepWakeMux);
+    if (enable != sleepWakeArmed) {
+        sleepWakeArmed = enable;
+        for (uint8_t i = 0; i < sizeof(WAKE_PINS) / sizeof(WAKE_PINS[0]); ++i) {
+            gpio_num_t pin = (gpio_num_t)WAKE_PINS[i].pin;
+            if (enable) {
+                gpio_wakeup_enable(pin, WAKE_PINS[i].level);
+            } else {
+                gpio_wakeup_disable(pin);
+                gpio_set_intr_type(pin, WAKE_PINS[i].edge);
+            }
+        }
+        if (enable)
+            esp_sleep_enable_gpio_wakeup();
+    }
+    portEXIT_CRITICAL_SAFE(&sleepWakeMux);
 }
 
 void onPowerButtonShortPress() {
@@ -738,17 +1966,14 @@ void onPowerButtonShortPress() {
         case MODE_CCY:
         case MODE_METROHIGH:
         case MODE_METROLOW:
+        case MODE_CCRATE:
+        case MODE_ENCCC:
         case MODE_BRIGHTNESS:
         case MODE_TIMEOUT:
             mode = MODE_SETTINGS;
             break;
         case MODE_SETTINGS:
-            {
-            uint32_t magic = MAGIC;
-                EEPROM.writeBytes(0, settings, settingsSize);
-                EEPROM.writeBytes(settingsSize, &magic, 4);
-                EEPROM.commit();
-            }
+            saveSettings();
             // Fall through to default
         default:
             selPad = 255;
@@ -762,140 +1987,434 @@ void onPowerButtonLongPress() {
     screenOn();
 }
 
+// Mark all buttons in an array to be redrawn on next update
+void invalidateButtons(gfxButton* btns, uint8_t count) {
+    for (uint8_t i = 0; i < count; ++i)
+        btns[i].invalidate();
+}
+
+// Allocate sprite buffers and display staging buffers when first drawn, after BLE has started
+void initDisplay() {
+    canvas->createSprite(240, 300);
+    canvas->setFreeFont(&Riban_24);
+    menuCanvas->createSprite(240, 240);
+    menuCanvas->setFreeFont(&Riban_24);
+    statusCanvas->createSprite(240, 20);
+    statusCanvas->setFreeFont(&Riban_24);
+    if (psramFound()) {
+        // Scratch sprite for button tiles, created with the other sprites before DMA is started so that it is also in PSRAM
+        tileCanvas->createSprite(TILE_MAX_W, TILE_MAX_H);
+        tileCanvas->setFreeFont(&Riban_24);
+    }
+    initDisplayQueue();
+}
+
+/*  Allocate display staging buffers and start SPI DMA
+    Falls back to blocking writes if DMA capable memory is not available.
+*/
+void initDisplayQueue() {
+    for (uint8_t i = 0; i < 2; ++i)
+        dmaBuffers[i] = (uint16_t*)heap_caps_malloc(DMA_BAND_PIXELS * 2, MALLOC_CAP_DMA);
+    if (!dmaBuffers[0] || !dmaBuffers[1] || !ttgo->tft->initDMA()) {
+        free(dmaBuffers[0]);
+        free(dmaBuffers[1]);
+        dmaBuffers[0] = dmaBuffers[1] = nullptr;
+    }
+    ttgo->tft->setSwapBytes(false); // Sprite buffers are already in panel byte order
+}
+
+/*  Write a region of a sprite to the display
+    sprite: Source sprite
+    sx, sy, w, h: Region of sprite
+    dx, dy: Display position (region is clipped to display)
+    The region is copied in bands to alternate staging buffers. Each band streams out by DMA whilst the next is copied, and the last band is left streaming whilst the next frame is composed. Sprites may be modified as soon as this returns.
+*/
+void pushRegion(TFT_eSprite* sprite, int16_t sx, int16_t sy, int16_t w, int16_t h, int16_t dx, int16_t dy) {
+    if (dx < 0) {
+        sx -= dx;
+        w += dx;
+        dx = 0;
+    }
+    if (dy < 0) {
+        sy -= dy;
+        h += dy;
+        dy = 0;
+    }
+    if (dx + w > 240)
+        w = 240 - dx;
+    if (dy + h > 240)
+        h = 240 - dy;
+    if (w <= 0 || h <= 0)
+        return;
+    uint16_t* buffer = (uint16_t*)sprite->getPointer();
+    int16_t width = sprite->width();
+    if (!displayBusy) {
+        ttgo->tft->startWrite();
+        displayBusy = true;
+    }
+    if (dmaBuffers[0]) {
+        int16_t bandRows = DMA_BAND_PIXELS / w;
+        for (int16_t row = 0; row < h; row += bandRows) {
+            int16_t rows = h - row < bandRows ? h - row : bandRows;
+            uint16_t* band = dmaBuffers[dmaNext];
+            dmaNext = !dmaNext;
+            for (int16_t i = 0; i < rows; ++i)
+                memcpy(band + i * w, buffer + (sy + row + i) * width + sx, w * 2);
+            // Waits for previous band (other buffer) to complete then starts this band
+            ttgo->tft->pushImageDMA(dx, dy + row, w, rows, band);
+        }
+    } else {
+        for (int16_t row = 0; row < h; ++row)
+            ttgo->tft->pushImage(dx, dy + row, w, 1, buffer + (sy + row) * width + sx);
+    }
+    framePixels += w * h;
+}
+
+// Write a whole sprite to the display (clipped to display)
+void pushSprite(TFT_eSprite* sprite, int16_t x, int16_t y) {
+    pushRegion(sprite, 0, 0, sprite->width(), sprite->height(), x, y);
+}
+
+// Write the dirty regions of a sprite to the display
+void pushDamage(TFT_eSprite* sprite, int16_t x, int16_t y) {
+    for (uint8_t i = 0; i < damage.count(); ++i) {
+        const rect_t& r = damage[i];
+        pushRegion(sprite, r.x, r.y, r.w, r.h, x + r.x, y + r.y);
+    }
+    damage.clear();
+}
+
+// Close display write transaction if last transfer has completed. Returns true if display is idle.
+bool displayIdle() {
+    if (displayBusy && !(dmaBuffers[0] && ttgo->tft->dmaBusy())) {
+        ttgo->tft->endWrite();
+        displayBusy = false;
+    }
+    return !displayBusy;
+}
+
+// Wait for display writes to complete, e.g. before other display access
+void displayWait() {
+    if (displayBusy && dmaBuffers[0])
+        ttgo->tft->dmaWait();
+    displayIdle();
+}
+
+// Mark outline of a circle as dirty using four arcs rather than its whole bounding box
+void damageCircle(int16_t x, int16_t y, int16_t r) {
+    int16_t d = r * 181 / 256 + 1; // r * sin(45)
+    damage.add(x - d, y - r, 2 * d + 1, r - d + 2); // Top
+    damage.add(x - d, y + d - 1, 2 * d + 1, r - d + 2); // Bottom
+    damage.add(x - r, y - d, r - d + 2, 2 * d + 1); // Left
+    damage.add(x + d - 1, y - d, r - d + 2, 2 * d + 1); // Right
+}
+
+// Draw the X-Y crosshairs and pulse circle, erasing previous drawing if not redrawing whole view
+void drawXY(uint8_t x, uint8_t y) {
+    static uint8_t drawnX = 0, drawnY = 0; // Position of crosshair currently on canvas
+    bool moved = (drawnX != x || drawnY != y);
+    if (!redrawAll) {
+        if (!moved && !pulseRadius && !lastPulseRadius)
+            return;
+        if (lastPulseRadius) {
+            canvas->drawCircle(120, 140, lastPulseRadius, TFT_BLACK);
+            damageCircle(120, 140, lastPulseRadius);
+        }
+        // Pulse erasure may have cut the crosshair so always redraw it
+        canvas->drawLine(drawnX, 0, drawnX, 240, TFT_BLACK);
+        canvas->drawLine(0, drawnY, 240, drawnY, TFT_BLACK);
+        damage.add(drawnX, 0, 1, 241);
+        damage.add(0, drawnY, 241, 1);
+    }
+    lastPulseRadius = pulseRadius;
+    if (pulseRadius) {
+        canvas->drawCircle(120, 140, pulseRadius, TFT_DARKCYAN);
+        damageCircle(120, 140, pulseRadius);
+        --pulseRadius;
+    }
+    canvas->drawLine(x, 0, x, 240, TFT_YELLOW);
+    canvas->drawLine(0, y, 240, y, TFT_YELLOW);
+    damage.add(x, 0, 1, 241);
+    damage.add(0, y, 241, 1);
+    drawnX = x;
+    drawnY = y;
+}
+
+// Draw encoder strips, each filled to the value of its controller. Only strips whose value changed are redrawn.
+void drawEncoders() {
+    static uint8_t drawn[4]; // Values currently drawn on canvas
+    const uint8_t* values = ccValues[profile->midiChan];
+    for (uint8_t strip = 0; strip < 4; ++strip) {
+        uint8_t val = values[encoderCc(strip)];
+        if (!redrawAll && val == drawn[strip])
+            continue;
+        drawn[strip] = val;
+        int16_t x = strip * 60;
+        canvas->fillRoundRect(x, 0, 59, 220, 10, TFT_DARKGREY);
+        damage.add(x, 0, 59, 220);
+        if (val == CC_UNKNOWN)
+            continue;
+        int16_t h = val * 220 / 127;
+        if (h)
+            canvas->fillRoundRect(x, 220 - h, 59, h, h < 20 ? h / 2 : 10, 0x22ad);
+        canvas->setTextDatum(MC_DATUM);
+        canvas->drawNumber(val, x + 30, 20, 1);
+        canvas->setTextDatum(TL_DATUM);
+    }
+}
+
+// Draw the settings menu (always whole view). Only rows in view are drawn.
+void drawSettings() {
+    for (int16_t i = settingsList.firstVisible(); i < settingsList.endVisible(); ++i) {
+        gfxButton* btn = &settingsBtns[i];
+        btn->m_y = settingsList.rowY(i);
+        if (i == SETTING_BRIGHTNESS)
+            btn->drawBar(100 * settings[SETTING_BRIGHTNESS] / 255);
+        else
+            btn->draw();
+        canvas->setTextDatum(MR_DATUM);
+        int16_t x = 230;
+        int16_t y = 27 + btn->m_y;
+        if (i == SETTING_BLE || i == SETTING_OTA) {
+            if (settings[i])
+                canvas->drawString("ON", x, y, 1);
+            else
+                canvas->drawString("OFF", x, y, 1);
+        }
+        else if (i == SETTING_MIDICHAN)
+            canvas->drawNumber(profile->midiChan + 1, x, y, 1);
+        else if (i == SETTING_BRIGHTNESS) {
+            char s[10];
+            sprintf(s, "%d%%", 100 * settings[SETTING_BRIGHTNESS] / 255);
+            canvas ->drawString(s, x, y, 1);
+        }
+        else if (i == SETTING_ENCMODE)
+            canvas->drawString(profile->encMode ? "Abs" : "Rel", x, y, 1);
+        else if (i == SETTING_PROFILE)
+            canvas->drawString(profile->name, x, y, 1);
+        else if (i == SETTING_CCRATE) {
+            char s[10];
+            sprintf(s, "%dms", settings[SETTING_CCRATE]);
+            canvas->drawString(s, x, y, 1);
+        }
+        else if (i == SETTING_TIMEOUT) {
+            switch(settings[SETTING_TIMEOUT]) {
+                case 0:
+                    canvas->drawString("None", x, y, 1);
+                    break;
+                case 15:
+                    canvas->drawString("15s", x, y, 1);
+                    break;
+                case 30:
+                    canvas->drawString("30s", x, y, 1);
+                    break;
+                case 60:
+                    canvas->drawString("1 mins", x, y, 1);
+                    break;
+                case 120:
+                    canvas->drawString("2 mins", x, y, 1);
+                    break;
+                case 180:
+                    canvas->drawString("3 mins", x, y, 1);
+                    break;
+                case 240:
+                    canvas->drawString("4 mins", x, y, 1);
+                    break;
+                default:
+                    canvas->drawNumber(settings[SETTING_TIMEOUT], x, y, 1);
+            }
+        } else
+            canvas->drawNumber(*settingValue(i), x, y, 1);
+        canvas->setTextDatum(TL_DATUM);
+    }
+    if (touching || settingsList.moving()) {
+        int16_t thumbY, thumbH;
+        settingsList.thumb(220, thumbY, thumbH);
+        canvas->fillRect(236, 0, 4, 220, TFT_DARKGREY);
+        canvas->fillRect(236, thumbY, 4, thumbH, TFT_LIGHTGREY);
+    }
+}
+
+/*  Update display
+    Only elements that have changed are redrawn and only the regions they touch are pushed to the display.
+    A change of view, drag or settings change redraws the whole view.
+*/
 void refresh() {
-    canvas->fillSprite(TFT_BLACK); // Clear screen
+    if (!canvas->created())
+        initDisplay();
+    uint32_t startUs = micros();
+    static uint8_t lastMode = MODE_NONE;
+    static bool lastMenuShowing = false;
+    static bool lastSideDrag = false;
+    static int32_t lastSettingsOffset = -1;
+    static bool lastMoving = false;
+    static bool lastTouching = false;
+    static uint8_t lastSettings[sizeof(settings)];
+
+    bool dragging = (topDrag > 20 || bottomDrag < 220);
+    bool sideDrag = (rightDrag < 240 || leftDrag);
+    if (mode != lastMode || menuShowing != lastMenuShowing || sideDrag != lastSideDrag || dragging)
+        redrawAll = true;
+    if (mode == MODE_SETTINGS && !menuShowing) {
+        settingsList.update(micros());
+        bool moving = settingsList.moving();
+        if (settingsList.offset() != lastSettingsOffset || touching != lastTouching || moving != lastMoving || memcmp(settings, lastSettings, settingsSize))
+            redrawAll = true;
+        lastSettingsOffset = settingsList.offset();
+        lastMoving = moving;
+        lastTouching = touching;
+        memcpy(lastSettings, settings, settingsSize);
+    }
+    lastMode = mode;
+    lastMenuShowing = menuShowing;
+    lastSideDrag = sideDrag;
+    framePixels = 0;
+
+    if (redrawAll) {
+        damage.addAll();
+        canvas->fillSprite(TFT_BLACK); // Clear screen
+        menuCanvas->fillSprite(TFT_BLACK);
+        invalidateButtons(menuBtns, 7);
+        invalidateButtons(profileBtns, PROFILE_COUNT);
+        invalidateButtons(launchPads, 16);
+        invalidateButtons(navigationBtns, 9);
+        invalidateButtons(numPad, 11);
+        invalidateButtons(sleepBtns, 8);
+    }
     canvas->setTextColor(TFT_WHITE);  // Adding a background colour erases previous text automatically
-    switch(mode) {
-        case MODE_ENCODERS:
-            canvas->fillRoundRect(0, 0, 59, 220, 10, TFT_DARKGREY);
-            canvas->fillRoundRect(60, 0, 59, 220, 10, TFT_DARKGREY);
-            canvas->fillRoundRect(120, 0, 59, 220, 10, TFT_DARKGREY);
-            canvas->fillRoundRect(180, 0, 59, 220, 10, TFT_DARKGREY);
-            break;
-        case MODE_XY:
-            canvas->drawLine(crosshair_x, 0, crosshair_x, 240, TFT_YELLOW);
-            canvas->drawLine(0, crosshair_y, 240, crosshair_y, TFT_YELLOW);
-            if (pulseRadius)
-                canvas->drawCircle(120, 140, pulseRadius--, TFT_DARKCYAN);
-            break;
-        case MODE_PADS:
-            for (uint8_t pad = 0; pad < 16; ++pad) {
-                if (padFlashing[pad] == 1)
-                    launchPads[pad]->draw(flash);
-                else if (padFlashing[pad] == 2)
-                    launchPads[pad]->draw(); //!@todo Pulse
-                else
-                    launchPads[pad]->draw(selPad == pad);
-            }
-            break;
-        case MODE_NAVIGATE1:
-        case MODE_NAVIGATE2:
-            for (uint8_t pad = 0; pad < 9; ++pad)
-                navigationBtns[pad]->draw(navigationBtns[pad]->m_mode == selPad);
-            break;
-        case MODE_SETTINGS:
-            // Settings scrollbar
-            for (int16_t i = 0; i < settingsSize; ++i) {
-                gfxButton* btn = settingsBtns[i];
-                btn->m_y = i * 55 - settingsOffset;
-                if (i == SETTING_BRIGHTNESS)
-                    btn->drawBar(100 * settings[SETTING_BRIGHTNESS] / 255);
-                else
-                    btn->draw();
-                canvas->setTextDatum(MR_DATUM);
-                int16_t x = 230;
-                int16_t y = 27 + btn->m_y;
-                if (i == SETTING_BLE)
-                    if (settings[SETTING_BLE])
-                        canvas->drawString("ON", x, y, 1);
-                    else
-                        canvas->drawString("OFF", x, y, 1);
-                else if (i == SETTING_MIDICHAN)
-                    canvas->drawNumber(settings[i] + 1, x, y, 1);
-                else if (i == SETTING_BRIGHTNESS) {
-                    char s[10];
-                    sprintf(s, "%d%%", 100 * settings[SETTING_BRIGHTNESS] / 255);
-                    canvas ->drawString(s, x, y, 1);
-                }
-                else if (i == SETTING_TIMEOUT) {
-                    switch(settings[SETTING_TIMEOUT]) {
-                        case 0:
-                            canvas->drawString("None", x, y, 1);
-                            break;
-                        case 15:
-                            canvas->drawString("15s", x, y, 1);
-                            break;
-                        case 30:
-                            canvas->drawString("30s", x, y, 1);
-                            break;
-                        case 60:
-                            canvas->drawString("1 mins", x, y, 1);
-                            break;
-                        case 120:
-                            canvas->drawString("2 mins", x, y, 1);
-                            break;
-                        case 180:
-                            canvas->drawString("3 mins", x, y, 1);
-                            break;
-                        case 240:
-                            canvas->drawString("4 mins", x, y, 1);
-                            break;
-                        default:
-                            canvas->drawNumber(settings[SETTING_TIMEOUT], x, y, 1);
+    if (!menuShowing || dragging) {
+        switch(mode) {
+            case MODE_ENCODERS:
+                drawEncoders();
+                break;
+            case MODE_XY:
+                drawXY(crosshair_x, crosshair_y);
+                break;
+            case MODE_TILT:
+                drawXY(tilt_x, tilt_y);
+                break;
+            case MODE_PADS:
+                {
+                    // Flash on first half of beat. Pulse brightness falls from beat start to half beat then rises.
+                    uint8_t phase = beatPhase();
+                    bool flash = phase < 128;
+                    uint8_t level = (phase < 128 ? 127 - phase : phase - 128) * PAD_RAMP_STEPS / 128;
+                    for (uint8_t pad = 0; pad < 16; ++pad) {
+                        if (padFlashing[pad] == 1) {
+                            launchPads[pad].update(flash);
+                        } else if (padFlashing[pad] == 2) {
+                            launchPads[pad].setBg(padRamps[padColour[pad]][level]); // Only redraws when level changes
+                            launchPads[pad].update(selPad == pad);
+                        } else {
+                            launchPads[pad].update(selPad == pad);
+                        }
                     }
-                } else
-                    canvas->drawNumber(settings[i], x, y, 1);
-                canvas->setTextDatum(TL_DATUM);
-            }
-            if (touching) {
-                int16_t scrollbarHeight = 55 * (settingsSize - 4) / 4; 
-                canvas->fillRect(236, 0, 4, 240, TFT_DARKGREY);
-                canvas->fillRect(236, settingsOffset * 220 / ((settingsSize - 3) * 55), 4, scrollbarHeight, TFT_LIGHTGREY);
-            }
-            break;
-        case MODE_MIDICHAN:
-        case MODE_CCX:
-        case MODE_CCY:
-        case MODE_METROHIGH:
-        case MODE_METROLOW:
-            // Draw numeric keypad
-            for (uint8_t i = 0; i < 11; ++i)
-                numPad[i]->draw();
-            break;
-        case MODE_TIMEOUT:
-            for (uint8_t i = 0; i < 8; ++i)
-                sleepBtns[i]->draw();
-            break;
-    }
+                }
+                break;
+            case MODE_NAVIGATE1:
+            case MODE_NAVIGATE2:
+                for (uint8_t pad = 0; pad < 9; ++pad)
+                    navigationBtns[pad].update(navigationBtns[pad].m_mode == selPad);
+                break;
+            case MODE_SETTINGS:
+                if (redrawAll)
+                    drawSettings();
+                break;
+            case MODE_MIDICHAN:
+            case MODE_CCX:
+            case MODE_CCY:
+            case MODE_METROHIGH:
+            case MODE_METROLOW:
+            case MODE_CCRATE:
+            case MODE_ENCCC:
+                // Draw numeric keypad
+                for (uint8_t i = 0; i < 11; ++i)
+                    numPad[i].update();
+                break;
+            case MODE_TIMEOUT:
+                for (uint8_t i = 0; i < 8; ++i)
+                    sleepBtns[i].update();
+                break;
+            case MODE_PROFILE:
+                for (uint8_t i = 0; i < PROFILE_COUNT; ++i)
+                    profileBtns[i].update(profile == &profiles[i]);
+                break;
+        }
 
-    canvas->setTextDatum(MC_DATUM);
-    if (rightDrag < 240)
-        canvas->drawString("<", 220, 110);
-    else if (leftDrag)
-        canvas->drawString(">", 20, 110);
-    menuCanvas->fillSprite(TFT_BLACK);
-    for (uint8_t pad = 0; pad < 5; ++pad)
-        menuBtns[pad]->draw(selPad == pad);
+        if (redrawAll) {
+            canvas->setTextDatum(MC_DATUM);
+            if (rightDrag < 240)
+                canvas->drawString("<", 220, 110);
+            else if (leftDrag)
+                canvas->drawString(">", 20, 110);
+        }
+    }
+    if (menuShowing || dragging)
+        for (uint8_t pad = 0; pad < 7; ++pad)
+            menuBtns[pad].update(selPad == pad);
 
+    uint32_t pushUs = micros();
     if (topDrag > 20) {
-        menuCanvas->pushSprite(0, topDrag - 240);
-        canvas->pushSprite(0, topDrag);
-        return;
+        pushSprite(menuCanvas, 0, topDrag - 240);
+        pushSprite(canvas, 0, topDrag);
+        damage.clear();
     } else if (bottomDrag < 220) {
-        menuCanvas->pushSprite(0, bottomDrag - 240);
-        canvas->pushSprite(0, bottomDrag);
-        return;
-    } else if (menuShowing) {
-        menuCanvas->pushSprite(0, 20);
+        pushSprite(menuCanvas, 0, bottomDrag - 240);
+        pushSprite(canvas, 0, bottomDrag);
+        damage.clear();
     } else {
-        canvas->pushSprite(0, 20);
+        if (menuShowing)
+            pushDamage(menuCanvas, 0, 20);
+        else
+            pushDamage(canvas, 0, 20);
+        showStatus();
+        redrawAll = false; // Keep redrawing whole view whilst dragging
+    }
+    pixelsPushed += framePixels;
+
+    uint32_t endUs = micros();
+    if (framePixels)
+        perf[PERF_PUSH].add(endUs - pushUs);
+    perf[PERF_REFRESH].add(endUs - startUs);
+    if (rxPixelUs) {
+        // Last band may still be streaming so wait for it to reach display. Only frames showing incoming MIDI wait.
+        displayWait();
+        perf[PERF_BLE_TO_PIXEL].add(micros() - rxPixelUs);
+        rxPixelUs = 0;
     }
-    showStatus();
 }
 
 void showStatus() {
+    static uint8_t lastBattery = 255;
+    static bool lastCharging = false;
+    static uint8_t lastBle = 255;
+    static bool lastConnected = false;
+    static bool lastPerfOverlay = false;
+    static uint8_t lastOta = 255;
+    static uint32_t nextOverlay = 0;
+    bool connected = settings[SETTING_BLE] && BLEMidiServer.isConnected();
+    if (perfOverlay) {
+        if (!redrawAll && lastPerfOverlay && now < nextOverlay)
+            return;
+        nextOverlay = now + 1000;
+        lastPerfOverlay = true;
+        showPerf();
+        return;
+    }
+    if (lastPerfOverlay) {
+        lastPerfOverlay = false;
+        lastBattery = 255; // Force redraw
+    }
+    if (!redrawAll && battery == lastBattery && charging == lastCharging && settings[SETTING_BLE] == lastBle && connected == lastConnected && otaProgress == lastOta)
+        return;
+    lastOta = otaProgress;
+    lastBattery = battery;
+    lastCharging = charging;
+    lastBle = settings[SETTING_BLE];
+    lastConnected = connected;
+
     statusCanvas->fillSprite(0x1082);
-    char s[10];
+    char s[12];
     statusCanvas->fillRect(180, 5, 20, 10, TFT_DARKGREY); // Battery body
     statusCanvas->fillRect(200, 7, 2, 6, TFT_DARKGREY); // Battery tip
     statusCanvas->fillRect(180, 6, 20 * battery / 100, 8, battery < 10?TFT_RED:TFT_DARKGREEN); // Battery content
@@ -920,26 +2439,105 @@ void showStatus() {
         /*statusCanvas->setTextColor(BLEMidiServer.isConnected()?TFT_BLUE:TFT_DARKGREY);
         statusCanvas->drawString("\x8D", 226, 10, 1);
         */
-        statusCanvas->fillRoundRect(224, 1, 10, 18, 4, BLEMidiServer.isConnected()?TFT_BLUE:TFT_DARKGREY);
+        statusCanvas->fillRoundRect(224, 1, 10, 18, 4, connected?TFT_BLUE:TFT_DARKGREY);
         statusCanvas->drawLine(226, 6, 230, 12, TFT_WHITE);
         statusCanvas->drawLine(230, 12, 228, 15, TFT_WHITE);
         statusCanvas->drawLine(228, 15, 228, 3, TFT_WHITE);
         statusCanvas->drawLine(228, 3, 230, 6, TFT_WHITE);
         statusCanvas->drawLine(230, 6, 226, 12, TFT_WHITE);
     }
-    statusCanvas->pushSprite(0, 0);
+    if (lastOta <= 100) {
+        sprintf(s, "Update %u%%", lastOta);
+        statusCanvas->setTextDatum(ML_DATUM);
+        statusCanvas->drawString(s, 2, 10, 2);
+    }
+    pushSprite(statusCanvas, 0, 0);
+}
+
+// Show latency statistics (avg / p99 in ms) and CPU load in status bar
+void showPerf() {
+    LatencyHistogram tx = perf[PERF_TOUCH_TO_BLE].get();
+    LatencyHistogram rx = perf[PERF_BLE_TO_PIXEL].get();
+    char s[64];
+    snprintf(s, sizeof(s), "T>B %u/%u  B>P %u/%u  %u%%", tx.avg() / 1000, tx.percentile(99) / 1000, rx.avg() / 1000, rx.percentile(99) / 1000, cpuLoad);
+    statusCanvas->fillSprite(0x1082);
+    statusCanvas->setTextColor(TFT_YELLOW);
+    statusCanvas->setTextDatum(ML_DATUM);
+    statusCanvas->drawString(s, 2, 10, 2);
+    pushSprite(statusCanvas, 0, 0);
+}
+
+// Print latency statistics and counters to serial port
+void dumpPerf() {
+    Serial.printf("%-10s %8s %8s %8s %8s %8s\n", "(us)", "count", "min", "avg", "p99", "max");
+    for (uint8_t i = 0; i < PERF_COUNT; ++i) {
+        LatencyHistogram h = perf[i].get();
+        Serial.printf("%-10s %8u %8u %8u %8u %8u\n", PERF_NAMES[i], h.count(), h.min(), h.avg(), h.percentile(99), h.max());
+    }
+    Serial.printf("cpu load %u%%, pixels pushed %u\n", cpuLoad, pixelsPushed);
+    Serial.printf("midi tx: %u messages in %u packets (max %u per packet), %u overflows\n", txMessages, txPackets, txMaxPerPacket, midiTx.overflows());
+    Serial.printf("midi rx: %u overflows, queue high water %u, %u late (latency %uus)\n", midiRx.overflows(), midiRx.highWater(), rxLate, BLE_MIDI_RX_LATENCY);
+    xSemaphoreTake(clockMutex, portMAX_DELAY);
+    ClockPll clock = clockPll;
+    xSemaphoreGive(clockMutex);
+    Serial.printf("clock: %s, %u.%u bpm, jitter %uus\n", clock.running() ? "running" : "stopped", clock.bpm() / 10, clock.bpm() % 10, clock.jitter());
+    uint32_t ms = millis();
+    uint32_t current = powerStats.averageCurrent(ms);
+    Serial.printf("%-10s %8s %8s %8s\n", "(power)", "entries", "time s", "est mA");
+    for (uint8_t i = 0; i < POWER_COUNT; ++i)
+        Serial.printf("%-10s %8u %8u %8u\n", POWER_NAMES[i], powerStats.entries(i), powerStats.residency(i, ms) / 1000, POWER_MA[i]);
+    Serial.printf("power: %s, light sleep %s, est average %u.%umA, %umAh used\n", POWER_NAMES[powerState], lightSleepAvailable ? "available" : "unavailable",
+        current / 10, current % 10, powerStats.charge(ms) / 1000);
+    Serial.printf("settings: version %u, %u values stored, %u flash writes since boot%s\n", storedSettings.version, storedSettings.count, settingsWrites, settingsDirty ? ", save pending" : "");
+    Serial.printf("ota: %s, %u of %u bytes, %u rewinds, %u queue overflows (high water %u)\n", OTA_STATE_NAMES[otaSession.state()], otaSession.offset(), otaSession.size(),
+        otaSession.gaps(), otaRx.overflows(), otaRx.highWater());
+    printBoot();
+    Serial.printf("heap: %u free, %u after boot, %u lowest since boot, %u lowest since reset, %u largest block\n",
+        (uint32_t)heap_caps_get_free_size(MALLOC_CAP_INTERNAL), bootHeap, lowHeap,
+        (uint32_t)heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL), (uint32_t)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
 }
 
 void startBle() {
+    BLEDevice::setCustomGapHandler(onGapEvent);
+    BLEDevice::setCustomGattsHandler(onGattsEvent);
     BLEMidiServer.begin("riband");
+    // Allow bonding with Just Works pairing (no display of passkey) to encrypt link for firmware update
+    BLESecurity security;
+    security.setAuthenticationMode(ESP_LE_AUTH_REQ_SC_BOND);
+    security.setCapability(ESP_IO_CAP_NONE);
+    security.setInitEncryptionKey(ESP_BLE_ENC_KEY_MASK | ESP_BLE_ID_KEY_MASK);
+    midiCharacteristic = BLEDevice::getServer()->getServiceByUUID(BLE_MIDI_SERVICE_UUID)->getCharacteristic(BLE_MIDI_CHARACTERISTIC_UUID);
     BLEMidiServer.setOnConnectCallback(onBleConnect);
     BLEMidiServer.setOnDisconnectCallback(onBleDisconnect);
-    BLEMidiServer.setControlChangeCallback(onMidiCC);
-    BLEMidiServer.setNoteOnCallback(onMidiNoteOn);
+    startOta();
+}
+
+/*  Add firmware update service to BLE server (once - server keeps it whilst BLE is restarted)
+    Update characteristics are only accessible over an encrypted link so the client must pair (and bond) first. MIDI does not require pairing.
+*/
+void startOta() {
+    BLEServer* server = BLEDevice::getServer();
+    BLEService* service = server->getServiceByUUID(OTA_SERVICE_UUID);
+    if (!service) {
+        service = server->createService(OTA_SERVICE_UUID);
+        BLECharacteristic* control = service->createCharacteristic(OTA_CONTROL_UUID, BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_NOTIFY);
+        control->setAccessPermissions(ESP_GATT_PERM_READ_ENCRYPTED | ESP_GATT_PERM_WRITE_ENCRYPTED);
+        BLE2902* notifyConfig = new BLE2902();
+        notifyConfig->setAccessPermissions(ESP_GATT_PERM_READ_ENCRYPTED | ESP_GATT_PERM_WRITE_ENCRYPTED);
+        control->addDescriptor(notifyConfig);
+        BLECharacteristic* data = service->createCharacteristic(OTA_DATA_UUID, BLECharacteristic::PROPERTY_WRITE_NR);
+        data->setAccessPermissions(ESP_GATT_PERM_WRITE_ENCRYPTED);
+        service->start();
+    }
+    otaControl = service->getCharacteristic(OTA_CONTROL_UUID);
+    otaData = service->getCharacteristic(OTA_DATA_UUID);
 }
 
 void toggleBle() {
     if (settings[SETTING_BLE]) {
+        midiCharacteristic = nullptr;
+        otaControl = nullptr;
+        otaData = nullptr;
         BLEMidiServer.end();
     } else {
         startBle();
@@ -953,6 +2551,8 @@ void numEntry() {
     uint8_t oMax;
     uint16_t v;
 
+    if (numPadClose)
+        return; // Showing entered value until processInput closes numpad
     if (oskSel == 10) {
         val = 0;
         offset = 0;
@@ -962,42 +2562,396 @@ void numEntry() {
     }
 
     if (mode == MODE_MIDICHAN) {
-        if (offset == 0 && v > 1 || offset == 1 && (v < 0 || v > 16))
+        if ((offset == 0 && v > 1) || (offset == 1 && v > 16))
             return;
         oMax = 2;
     } else {
-        if (offset == 0 && v > 1 || offset == 1 && v > 12 || offset == 2 && v > 127)
+        if ((offset == 0 && v > 1) || (offset == 1 && v > 12) || (offset == 2 && v > 127))
             return;
         oMax = 3;
     }
 
     char s[10];
     if (oskSel < 10) {
-        // Create numeric sting from current value
-        char fmt[5];
-        sprintf(fmt, "%%0%dd", ++offset);
-        sprintf(s, fmt, v);
+        // Create numeric string from current value, zero padded to quantity of digits entered
+        s[++offset] = '\0';
+        for (uint16_t d = v, i = offset; i > 0; d /= 10)
+            s[--i] = '0' + d % 10;
     }
 
     for (uint8_t i = 0; i < oMax - offset; ++i)
         sprintf(s + offset + i * 2, " _");
 
-    numPad[10]->setText(s);
+    numPad[10].setText(s);
 
     if (offset >= oMax) {
         offset = 0;
         val = 0;
         if (mode == MODE_MIDICHAN) {
             if (v > 0)
-                settings[SETTING_MIDICHAN] = v - 1;
+                profile->midiChan = v - 1;
+            bindMidiHandlers();
+        } else if (mode == MODE_ENCCC) {
+            for (uint8_t strip = 0; strip < PROFILE_ENCODERS; ++strip)
+                profile->encCc[strip] = (v + strip) & 0x7F;
         } else {
-            settings[mode - MODE_BLE] = v;
+            *settingValue(mode - MODE_BLE) = v;
         }
-        refresh(); // Show the briefly change before closing numpad
-        delay(300);
-        mode = MODE_SETTINGS;
-        numPad[10]->setText("");
+        numPadClose = now + 300; // Show the change briefly before closing numpad, without blocking input task
     } else {
         val = v;
     }
 }
+
+// Load profiles and settings from flash and make stored profile active
+void loadStorage() {
+    loadProfiles();
+    loadSettings();
+    profile = &profiles[settings[SETTING_PROFILE] < PROFILE_COUNT ? settings[SETTING_PROFILE] : 0];
+}
+
+// Load settings from flash, converting from older formats. Settings not stored keep their defaults.
+void loadSettings() {
+    uint16_t version = 0; // Legacy settings are version 0
+    settings_record_t record;
+    if (prefs.getBytesLength("settings") == sizeof(record) && prefs.getBytes("settings", &record, sizeof(record)) == sizeof(record) && record.valid()) {
+        storedSettings = record;
+        record.unpack(settings, settingsSize);
+        if (record.version >= SETTINGS_VERSION && record.count >= settingsSize)
+            return;
+        version = record.version;
+    } else if (!loadLegacySettings()) {
+        return;
+    }
+    migrateSettings(version);
+    saveSettings(); // Store in current format
+}
+
+// Convert settings loaded from an older version
+void migrateSettings(uint16_t version) {
+    if (version < 2) {
+        // MIDI mapping moved to profiles - previous mapping becomes first profile
+        Profile& p = profiles[0];
+        p.midiChan = settings[SETTING_MIDICHAN];
+        p.ccX = settings[SETTING_CCX];
+        p.ccY = settings[SETTING_CCY];
+        p.metroHigh = settings[SETTING_METROHIGH];
+        p.metroLow = settings[SETTING_METROLOW];
+        p.encMode = settings[SETTING_ENCMODE];
+        for (uint8_t strip = 0; strip < PROFILE_ENCODERS; ++strip)
+            p.encCc[strip] = (settings[SETTING_ENCCC] + strip) & 0x7F;
+        p.compile();
+        settings[SETTING_PROFILE] = 0;
+    }
+}
+
+// Load profiles from flash. Profiles not stored have default mapping.
+void loadProfiles() {
+    for (uint8_t i = 0; i < PROFILE_COUNT; ++i) {
+        Profile& p = profiles[i];
+        static_cast<profile_t&>(p) = DEFAULT_PROFILE;
+        snprintf(p.name, PROFILE_NAME_SIZE, "Profile %u", i + 1);
+        char key[12];
+        sprintf(key, "profile%u", i);
+        profile_record_t record;
+        size_t len = prefs.getBytes(key, &record, sizeof(record));
+        if (record.valid(len)) {
+            record.unpack(p);
+            storedProfileCrc[i] = record.crc;
+            // Convert values of older versions here when PROFILE_VERSION is incremented
+            if (record.size < sizeof(profile_t))
+                saveProfile(i); // Store in current format
+        }
+        p.compile();
+    }
+}
+
+// Get value of a setting - MIDI mapping settings are held in active profile
+uint8_t* settingValue(uint8_t setting) {
+    switch (setting) {
+        case SETTING_MIDICHAN:
+            return &profile->midiChan;
+        case SETTING_CCX:
+            return &profile->ccX;
+        case SETTING_CCY:
+            return &profile->ccY;
+        case SETTING_METROHIGH:
+            return &profile->metroHigh;
+        case SETTING_METROLOW:
+            return &profile->metroLow;
+        case SETTING_ENCCC:
+            return &profile->encCc[0];
+        case SETTING_ENCMODE:
+            return &profile->encMode;
+        default:
+            return &settings[setting];
+    }
+}
+
+// Load settings saved to EEPROM by firmware before versioned settings (settings array followed by MAGIC). Returns true if found.
+bool loadLegacySettings() {
+    static const uint8_t LEGACY_SIZES[] = {11, 9, 8}; // Quantity of settings saved by previous releases, largest first
+    bool found = false;
+    EEPROM.begin(LEGACY_SIZES[0] + 4);
+    for (uint8_t size : LEGACY_SIZES) {
+        uint32_t magic;
+        EEPROM.readBytes(size, &magic, 4);
+        if (magic == MAGIC) {
+            EEPROM.readBytes(0, settings, size < settingsSize ? size : settingsSize);
+            found = true;
+            break;
+        }
+    }
+    EEPROM.end();
+    return found;
+}
+
+// Request settings and active profile are written to flash by storage task
+void saveSettings() {
+    lockUi();
+    settingsDirty = true;
+    profilesDirty |= 1 << (profile - profiles);
+    settingsChanged = millis();
+    unlockUi();
+    if (storageTaskHandle)
+        xTaskNotifyGive(storageTaskHandle);
+}
+
+// Request a profile is written to flash by storage task
+void saveProfile(uint8_t index) {
+    lockUi();
+    profilesDirty |= 1 << index;
+    settingsChanged = millis();
+    unlockUi();
+    if (storageTaskHandle)
+        xTaskNotifyGive(storageTaskHandle);
+}
+
+/*  Write settings and profiles to flash if changed and not changed recently
+    force: Write any changes now, e.g. before restarting
+    Returns ticks until next call is required
+*/
+uint32_t processStorage(bool force) {
+    lockUi();
+    if (!settingsDirty && !profilesDirty) {
+        unlockUi();
+        return portMAX_DELAY;
+    }
+    uint32_t age = millis() - settingsChanged;
+    if (age < SETTINGS_SAVE_MS && !force) {
+        unlockUi();
+        return pdMS_TO_TICKS(SETTINGS_SAVE_MS - age);
+    }
+    bool writeSettings = settingsDirty;
+    settings_record_t record;
+    record.pack(SETTINGS_VERSION, settings, settingsSize);
+    settingsDirty = false;
+    unlockUi();
+    if (writeSettings && memcmp(&record, &storedSettings, sizeof(record)) != 0) { // Unchanged records are not written to avoid flash wear
+        if (prefs.putBytes("settings", &record, sizeof(record)) == sizeof(record)) {
+            storedSettings = record;
+            ++settingsWrites;
+        } else {
+            saveSettings(); // Retry later
+        }
+    }
+    for (uint8_t i = 0; i < PROFILE_COUNT; ++i) {
+        profile_record_t profileRecord;
+        lockUi();
+        bool dirty = profilesDirty & (1 << i);
+        profilesDirty &= ~(1 << i);
+        if (dirty)
+            profileRecord.pack(PROFILE_VERSION, profiles[i]);
+        unlockUi();
+        if (!dirty || profileRecord.crc == storedProfileCrc[i])
+            continue;
+        char key[12];
+        sprintf(key, "profile%u", i);
+        if (prefs.putBytes(key, &profileRecord, profileRecord.length()) == profileRecord.length()) {
+            storedProfileCrc[i] = profileRecord.crc;
+            ++settingsWrites;
+        } else {
+            saveProfile(i); // Retry later
+        }
+    }
+    return settingsDirty || profilesDirty ? pdMS_TO_TICKS(SETTINGS_SAVE_MS) : portMAX_DELAY;
+}
+
+// Apply queued firmware update commands and write image data to flash
+void processOta() {
+    static ota_rx_t rx; // Only used by storage task
+    lockUi();
+    bool enabled = settings[SETTING_OTA];
+    unlockUi();
+    while (otaRx.pop(rx)) {
+        if (!enabled && rx.type != OTA_CMD_STATUS && rx.type != OTA_CMD_ABORT) {
+            // Refuse update unless allowed in settings, abandoning any update in progress
+            if (rx.type != OTA_DATA || otaSession.state() == OTA_RECEIVING) {
+                abortOta(OTA_ERR_DISABLED);
+                notifyOtaStatus();
+            }
+            continue;
+        }
+        switch (rx.type) {
+            case OTA_DATA:
+                writeOta(rx);
+                break;
+            case OTA_CMD_BEGIN:
+                beginOta(rx);
+                break;
+            case OTA_CMD_END:
+                endOta();
+                break;
+            case OTA_CMD_ABORT:
+                abortOta(OTA_OK);
+                notifyOtaStatus();
+                break;
+            default:
+                notifyOtaStatus();
+                break;
+        }
+    }
+}
+
+/*  Start receiving firmware image, or continue receiving the same image after reconnecting
+    Space for the whole image is erased before replying so that writing data is not delayed by erasing.
+*/
+void beginOta(const ota_rx_t& rx) {
+    if (rx.len != OTA_BEGIN_SIZE - 1) {
+        abortOta(OTA_ERR_COMMAND);
+        notifyOtaStatus();
+        return;
+    }
+    uint32_t size = otaGet32(rx.data);
+    if (!otaSession.begin(size, rx.data + 4)) {
+        if (otaHandle)
+            esp_ota_abort(otaHandle);
+        otaHandle = 0;
+        otaStart = millis();
+        otaPartition = esp_ota_get_next_update_partition(nullptr);
+        if (!size || !otaPartition || size > otaPartition->size) {
+            otaSession.fail(OTA_ERR_SIZE);
+        } else if (esp_ota_begin(otaPartition, size, &otaHandle) != ESP_OK) {
+            otaHandle = 0;
+            otaSession.fail(OTA_ERR_FLASH);
+        }
+    }
+    // Shortest connection interval gives most writes per second
+    esp_ble_conn_update_params_t params = {};
+    memcpy(params.bda, otaPeer, sizeof(params.bda));
+    params.min_int = OTA_CONN_MIN;
+    params.max_int = OTA_CONN_MAX;
+    params.latency = 0;
+    params.timeout = 400; // Supervision timeout (units of 10ms)
+    esp_ble_gap_update_conn_params(&params);
+    updateOtaProgress();
+    notifyOtaStatus();
+}
+
+// Write image data to flash if it is next in sequence, otherwise ask client to resend from expected offset
+void writeOta(const ota_rx_t& rx) {
+    switch (otaSession.check(rx.offset, rx.len)) {
+        case OTA_CHUNK_WRITE:
+            if (esp_ota_write(otaHandle, rx.data, rx.len) != ESP_OK) {
+                abortOta(OTA_ERR_FLASH);
+                notifyOtaStatus();
+                break;
+            }
+            otaSession.written(rx.data, rx.len);
+            if (otaSession.offset() / OTA_PROGRESS_BYTES != (otaSession.offset() - rx.len) / OTA_PROGRESS_BYTES) {
+                updateOtaProgress();
+                notifyOtaStatus();
+            }
+            break;
+        case OTA_CHUNK_GAP:
+            notifyOtaStatus(true);
+            break;
+        case OTA_CHUNK_OVERRUN:
+            abortOta(OTA_ERR_SIZE);
+            notifyOtaStatus();
+            break;
+        default:
+            break; // Already written or resend requested
+    }
+}
+
+// Verify received image and restart into it. Client resends missing data if image is incomplete.
+void endOta() {
+    if (!otaSession.received()) {
+        notifyOtaStatus();
+        return;
+    }
+    if (!otaSession.verify()) {
+        abortOta(OTA_ERR_HASH);
+    } else {
+        esp_err_t err = esp_ota_end(otaHandle); // Also checks image is a valid application
+        otaHandle = 0;
+        if (err != ESP_OK || esp_ota_set_boot_partition(otaPartition) != ESP_OK)
+            otaSession.fail(OTA_ERR_IMAGE);
+        else
+            otaSession.complete();
+    }
+    updateOtaProgress();
+    notifyOtaStatus();
+    if (otaSession.state() != OTA_COMPLETE)
+        return;
+    Serial.printf("ota: %u bytes received in %ums, restarting\n", otaSession.size(), millis() - otaStart);
+    processStorage(true);
+    vTaskDelay(pdMS_TO_TICKS(OTA_RESTART_MS)); // Allow status notification to be sent
+    esp_restart();
+}
+
+// Abandon firmware update with error (OTA_OK if requested by client)
+void abortOta(uint8_t error) {
+    if (otaHandle)
+        esp_ota_abort(otaHandle);
+    otaHandle = 0;
+    otaSession.fail(error);
+    updateOtaProgress();
+}
+
+// Notify firmware update status to client. rewind: Request client resends data from offset.
+void notifyOtaStatus(bool rewind) {
+    BLECharacteristic* characteristic = otaControl;
+    if (!characteristic)
+        return;
+    uint16_t maxChunk = bleMtu - 3 - OTA_DATA_HEADER;
+    if (maxChunk > OTA_CHUNK_MAX)
+        maxChunk = OTA_CHUNK_MAX;
+    uint8_t status[OTA_STATUS_SIZE];
+    otaPackStatus(status, otaSession.status(maxChunk, rewind));
+    characteristic->setValue(status, sizeof(status));
+    characteristic->notify();
+}
+
+// Show update progress in status bar and keep display on (and CPU at full speed) whilst receiving
+void updateOtaProgress() {
+    if (otaSession.state() != OTA_RECEIVING) {
+        otaProgress = 255;
+        return;
+    }
+    otaProgress = (uint64_t)otaSession.offset() * 100 / otaSession.size();
+    lockUi();
+    screenOn();
+    unlockUi();
+}
+
+#if CONFIG_APP_ROLLBACK_ENABLE
+// Arduino core marks updated firmware valid at startup unless this returns true. Firmware does so itself once it has started properly.
+extern "C" bool verifyRollbackLater() {
+    return true;
+}
+#endif
+
+/*  Mark firmware valid after an update once it has started properly (storage, BLE, watch hardware and tasks running and first frame drawn)
+    If updated firmware resets before this, the bootloader rolls back to the previous firmware.
+*/
+void confirmFirmware() {
+#if CONFIG_APP_ROLLBACK_ENABLE
+    esp_ota_img_states_t state;
+    if (esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) == ESP_OK && state == ESP_OTA_IMG_PENDING_VERIFY) {
+        esp_ota_mark_app_valid_cancel_rollback();
+        Serial.printf("ota: updated firmware confirmed\n");
+    }
+#endif
+}
@@ -0,0 +1,299 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*  Host unit tests of BLE MIDI packet encoding against the BLE MIDI specification, round trip through the decoder, and mapping of received timestamps to local time
+    Run with: pio test -e native -f test_blemidi
+*/
+
+#include <unity.h>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include "blemidi.h"
+
+struct message_t {
+    uint8_t status;
+    uint8_t data1;
+    uint8_t data2;
+    uint16_t timestamp;
+};
+
+static std::vector<message_t> decoded; // Messages passed to decoder callback
+
+static void onMessage(uint8_t status, uint8_t data1, uint8_t data2, uint16_t timestamp) {
+    decoded.push_back({status, data1, data2, timestamp});
+}
+
+static void assertPacket(BleMidiEncoder& encoder, const std::vector<uint8_t>& expected) {
+    TEST_ASSERT_EQUAL_UINT16(expected.size(), encoder.size());
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected.data(), encoder.data(), expected.size());
+}
+
+void setUp() {
+    decoded.clear();
+}
+
+void tearDown() {}
+
+// Header holds timestamp bits 12..7, timestamp byte before status holds bits 6..0, both with bit 7 set
+void test_header_and_timestamp() {
+    BleMidiEncoder encoder;
+    encoder.begin(20);
+    TEST_ASSERT_TRUE(encoder.empty());
+    TEST_ASSERT_TRUE(encoder.add(1000, 0x90, 60, 100)); // 1000ms = 0x3E8
+    assertPacket(encoder, {0x87, 0xE8, 0x90, 60, 100});
+    TEST_ASSERT_EQUAL_UINT8(1, encoder.messages());
+}
+
+// Data bytes are limited to 7 bits so they cannot be taken as status or timestamp
+void test_data_masked() {
+    BleMidiEncoder encoder;
+    encoder.begin(20);
+    encoder.add(0, 0xB0, 0xFF, 0x80);
+    assertPacket(encoder, {0x80, 0x80, 0xB0, 0x7F, 0x00});
+}
+
+// Running status omits repeated status and the timestamp byte is omitted when it is also repeated
+void test_running_status() {
+    BleMidiEncoder encoder;
+    encoder.begin(20);
+    encoder.add(5, 0x90, 60, 100);
+    encoder.add(5, 0x90, 61, 100); // Same status and time: data only
+    encoder.add(6, 0x90, 62, 100); // Same status, new time: timestamp and data
+    encoder.add(6, 0x80, 60, 0); // New status: timestamp and status
+    encoder.add(6, 0xC0, 3, 0); // One data byte
+    assertPacket(encoder, {0x80, 0x85, 0x90, 60, 100, 61, 100, 0x86, 62, 100, 0x86, 0x80, 60, 0, 0x86, 0xC0, 3});
+    TEST_ASSERT_EQUAL_UINT8(5, encoder.messages());
+}
+
+// Timestamp low bits wrap within a packet without a new header - receiver adds 128ms when timestamp byte decreases
+void test_timestamp_wrap() {
+    BleMidiEncoder encoder;
+    encoder.begin(20);
+    encoder.add(126, 0xB0, 1, 2);
+    encoder.add(129, 0xB0, 1, 3);
+    assertPacket(encoder, {0x80, 0xFE, 0xB0, 1, 2, 0x81, 1, 3});
+    BleMidiDecoder decoder;
+    decoder.decode(encoder.data(), encoder.size(), onMessage);
+    TEST_ASSERT_EQUAL(2, decoded.size());
+    TEST_ASSERT_EQUAL_UINT16(126, decoded[0].timestamp);
+    TEST_ASSERT_EQUAL_UINT16(129, decoded[1].timestamp);
+}
+
+// 13-bit timestamp wraps from 8191 to 0
+void test_timestamp_13bit_wrap() {
+    BleMidiEncoder encoder;
+    encoder.begin(20);
+    encoder.add(8191, 0x90, 1, 1);
+    encoder.add(8193, 0x90, 2, 1);
+    assertPacket(encoder, {0xBF, 0xFF, 0x90, 1, 1, 0x81, 2, 1});
+    BleMidiDecoder decoder;
+    decoder.decode(encoder.data(), encoder.size(), onMessage);
+    TEST_ASSERT_EQUAL(2, decoded.size());
+    TEST_ASSERT_EQUAL_UINT16(8191, decoded[0].timestamp);
+    TEST_ASSERT_EQUAL_UINT16(1, decoded[1].timestamp);
+}
+
+// Messages more than 127ms after the first in a packet need a new packet as a receiver detects only one wrap
+void test_time_span_limit() {
+    BleMidiEncoder encoder;
+    encoder.begin(BLE_MIDI_MAX_PACKET);
+    TEST_ASSERT_TRUE(encoder.add(100, 0x90, 1, 1));
+    TEST_ASSERT_TRUE(encoder.add(227, 0x90, 2, 1));
+    TEST_ASSERT_FALSE(encoder.add(228, 0x90, 3, 1));
+    TEST_ASSERT_EQUAL_UINT8(2, encoder.messages());
+}
+
+// Packet never exceeds MTU - 3 and a message that does not fit is refused whole
+void test_split_at_mtu() {
+    BleMidiEncoder encoder;
+    encoder.begin(23 - 3);
+    uint8_t count = 0;
+    while (encoder.add(count, 0x90, count, 100))
+        ++count;
+    TEST_ASSERT_EQUAL_UINT8(6, count); // Header, 4 bytes for first message, then 3 bytes (timestamp and data) each
+    TEST_ASSERT_EQUAL_UINT16(20, encoder.size());
+    TEST_ASSERT_EQUAL_UINT8(6, encoder.messages());
+    // Next packet starts again with header, timestamp and status
+    encoder.clear();
+    TEST_ASSERT_TRUE(encoder.add(count, 0x90, count, 100));
+    assertPacket(encoder, {0x80, 0x86, 0x90, 6, 100});
+}
+
+// Packet size is limited to what the encoder buffer holds and to what the default MTU allows
+void test_packet_size_limits() {
+    BleMidiEncoder encoder;
+    encoder.begin(512 - 3);
+    uint16_t count = 0;
+    while (encoder.add(0, 0xB0, count & 0x7F, 0))
+        ++count;
+    TEST_ASSERT_LESS_OR_EQUAL(BLE_MIDI_MAX_PACKET, encoder.size());
+    TEST_ASSERT_TRUE(encoder.size() > BLE_MIDI_MAX_PACKET - 2);
+    encoder.begin(5);
+    count = 0;
+    while (encoder.add(0, 0xB0, count & 0x7F, 0))
+        ++count;
+    TEST_ASSERT_EQUAL_UINT16(19, encoder.size()); // Header, 4 bytes then 2 each (running status and time) up to BLE_MIDI_MIN_PACKET
+}
+
+// Random channel messages packed at several MTUs decode to the same messages and times
+void test_round_trip() {
+    static const uint8_t STATUS[] = {0x80, 0x90, 0xA0, 0xB0, 0xC0, 0xD0, 0xE0};
+    static const uint16_t MTUS[] = {23, 64, 185, 247};
+    srand(1);
+    for (uint16_t mtu : MTUS) {
+        std::vector<message_t> sent;
+        uint16_t ms = 8000; // Passes 13-bit wrap
+        for (uint16_t i = 0; i < 2000; ++i) {
+            ms += rand() % 3 == 0 ? rand() % 40 : 0;
+            uint8_t status = STATUS[rand() % 7] | (rand() % 2 ? 0 : rand() % 16);
+            uint8_t data2 = midiDataLength(status) > 1 ? rand() & 0x7F : 0;
+            sent.push_back({status, (uint8_t)(rand() & 0x7F), data2, (uint16_t)(ms & 0x1FFF)});
+        }
+        BleMidiEncoder encoder;
+        BleMidiDecoder decoder;
+        decoded.clear();
+        encoder.begin(mtu - 3);
+        uint16_t packets = 0;
+        for (const message_t& msg : sent) {
+            if (encoder.add(msg.timestamp, msg.status, msg.data1, msg.data2))
+                continue;
+            TEST_ASSERT_LESS_OR_EQUAL(mtu - 3, encoder.size());
+            decoder.decode(encoder.data(), encoder.size(), onMessage);
+            ++packets;
+            encoder.clear();
+            TEST_ASSERT_TRUE(encoder.add(msg.timestamp, msg.status, msg.data1, msg.data2));
+        }
+        decoder.decode(encoder.data(), encoder.size(), onMessage);
+        TEST_ASSERT_EQUAL(sent.size(), decoded.size());
+        for (size_t i = 0; i < sent.size(); ++i) {
+            TEST_ASSERT_EQUAL_HEX8(sent[i].status, decoded[i].status);
+            TEST_ASSERT_EQUAL_UINT8(sent[i].data1, decoded[i].data1);
+            TEST_ASSERT_EQUAL_UINT8(sent[i].data2, decoded[i].data2);
+            TEST_ASSERT_EQUAL_UINT16(sent[i].timestamp, decoded[i].timestamp);
+        }
+        TEST_ASSERT_TRUE(packets > 0);
+    }
+}
+
+// Range of timebase errors (us)
+struct map_error_t {
+    int32_t min;
+    int32_t max;
+};
+
+/*  Map a stream of messages sent at regular intervals
+    Sender clock is offset (ms) from and drifts (ppm) against local clock. Each message is delayed by up to jitter ms and messages arrive in order.
+    Returns range of mapped time minus local send time, excluding first 20 messages whilst least delay is found
+*/
+static map_error_t mapStream(BleMidiTimebase& timebase, int64_t offsetMs, int32_t ppm, uint32_t jitter, uint32_t messages, uint32_t interval=10, int64_t start=1000000) {
+    map_error_t result = {INT32_MAX, INT32_MIN};
+    uint32_t seed = 7;
+    uint32_t lastArrival = start;
+    int64_t local = start;
+    for (uint32_t n = 0; n < messages; ++n, local += interval * 1000) {
+        seed = seed * 1103515245 + 12345;
+        int64_t senderUs = local + offsetMs * 1000 + local * ppm / 1000000;
+        uint16_t timestamp = (uint64_t)(senderUs / 1000) & 0x1FFF;
+        uint32_t arrival = local + (jitter ? (seed >> 8) % (jitter * 1000) : 0);
+        if ((int32_t)(arrival - lastArrival) < 0)
+            arrival = lastArrival;
+        lastArrival = arrival;
+        int32_t error = timebase.map(timestamp, arrival) - (uint32_t)local;
+        if (n < 20)
+            continue;
+        if (error < result.min)
+            result.min = error;
+        if (error > result.max)
+            result.max = error;
+    }
+    return result;
+}
+
+// First message is taken as least delayed
+void test_timebase_first_message() {
+    BleMidiTimebase timebase;
+    TEST_ASSERT_EQUAL_UINT32(5000000, timebase.map(100, 5000000));
+    TEST_ASSERT_EQUAL_UINT32(0, timebase.delay());
+    TEST_ASSERT_EQUAL_UINT32(5010000, timebase.map(110, 5013000));
+    TEST_ASSERT_EQUAL_UINT32(3000, timebase.delay());
+    timebase.reset();
+    TEST_ASSERT_EQUAL_UINT32(9000000, timebase.map(100, 9000000));
+}
+
+// Sender time is unwrapped across the 13-bit ms timestamp wrap, after long gaps and when a timestamp is before the previous one
+void test_timebase_13bit_wrap() {
+    BleMidiTimebase timebase;
+    map_error_t error = mapStream(timebase, 0, 0, 0, 3000); // 30s, wrapping 3 times
+    TEST_ASSERT_EQUAL_INT32(0, error.min);
+    TEST_ASSERT_EQUAL_INT32(0, error.max);
+
+    timebase.reset();
+    uint32_t us = 1000000;
+    timebase.map(0x1FF0, us);
+    TEST_ASSERT_EQUAL_UINT32(us + 20000, timebase.map(0x0004, us + 20000)); // Wraps between messages
+    TEST_ASSERT_EQUAL_UINT32(us + 18000, timebase.map(0x0002, us + 20000)); // Earlier than previous message
+    TEST_ASSERT_EQUAL_UINT32(2000, timebase.delay());
+    TEST_ASSERT_UINT32_WITHIN(100, us + 14000, timebase.map(0x1FFE, us + 20000)); // Earlier, before wrap (offset has crept a little)
+    TEST_ASSERT_UINT32_WITHIN(100, us + 20000 + 20000000, timebase.map((0x0004 + 20000) & 0x1FFF, us + 20000 + 20000000)); // Gap longer than timestamp range
+}
+
+// Sender clock ahead of or behind local clock by any amount maps to within delivery jitter of the least delayed message
+void test_timebase_sender_clock_offset() {
+    const int64_t offsets[] = {5000, -3000, 12345678, -12345678, 4096, -4096};
+    for (int64_t offset : offsets) {
+        BleMidiTimebase timebase;
+        map_error_t error = mapStream(timebase, offset, 0, 15, 3000);
+        TEST_ASSERT_TRUE(error.min >= -1000); // Timestamp resolution
+        TEST_ASSERT_TRUE(error.max < 4000); // Much less than 15ms delivery jitter
+    }
+}
+
+/*  Offset rises by a fraction of each message's delay so a slower sender clock is followed
+    Over a long stream the rise is pulled back by each least delayed message so it does not accumulate.
+*/
+void test_timebase_offset_creep() {
+    const int32_t drifts[] = {0, 100, -100, 200, -200};
+    for (int32_t ppm : drifts) {
+        BleMidiTimebase timebase;
+        map_error_t error = mapStream(timebase, 0, ppm, 15, 60000); // 10 minutes
+        TEST_ASSERT_TRUE(error.min >= -1500); // Slower sender would be 120ms behind without creep
+        TEST_ASSERT_TRUE(error.max < 4000);
+        // Error at end of stream is no larger than early in stream
+        map_error_t late = mapStream(timebase, 0, ppm, 15, 1000, 10, 1000000 + 600000000);
+        TEST_ASSERT_TRUE(late.min >= -1500);
+        TEST_ASSERT_TRUE(late.max < 4000);
+    }
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_header_and_timestamp);
+    RUN_TEST(test_data_masked);
+    RUN_TEST(test_running_status);
+    RUN_TEST(test_timestamp_wrap);
+    RUN_TEST(test_timestamp_13bit_wrap);
+    RUN_TEST(test_time_span_limit);
+    RUN_TEST(test_split_at_mtu);
+    RUN_TEST(test_packet_size_limits);
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_timebase_first_message);
+    RUN_TEST(test_timebase_13bit_wrap);
+    RUN_TEST(test_timebase_sender_clock_offset);
+    RUN_TEST(test_timebase_offset_creep);
+    return UNITY_END();
+}
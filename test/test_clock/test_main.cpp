@@ -0,0 +1,198 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*  Host unit tests of MIDI clock tracking: beat timing from jittered and bursty clock streams, lock, loss of lock and relock
+    Run with: pio test -e native -f test_clock
+*/
+
+#include <unity.h>
+#include <cmath>
+#include <vector>
+#include "clock.h"
+
+#define SETTLE_BEATS 4 // Beats after start not measured whilst tracking settles
+
+// Jitter of beat times about their mean latency (us)
+struct beat_error_t {
+    double rms;
+    double max;
+};
+
+static beat_error_t jitter(const std::vector<int64_t>& errors) {
+    double mean = 0;
+    for (int64_t e : errors)
+        mean += e;
+    mean /= errors.size();
+    beat_error_t result = {0, 0};
+    for (int64_t e : errors) {
+        double d = fabs(e - mean);
+        result.rms += d * d;
+        if (d > result.max)
+            result.max = d;
+    }
+    result.rms = sqrt(result.rms / errors.size());
+    return result;
+}
+
+/*  Send clocks at a tempo to a tracker
+    Each clock is delayed by up to jitter ms then held until the next BLE connection interval so several clocks may arrive together.
+    Each beat time predicted before its own clock arrives is compared with the ideal beat time, as the metronome schedules beats.
+    pll: Tracker, already started
+    start: Time of first clock (us)
+    tracked, raw: Populated with beat prediction errors and clock arrival errors (us)
+    Returns time of last clock (us)
+*/
+static uint64_t sendClocks(ClockPll& pll, uint32_t bpm, uint32_t interval, uint32_t jitter, uint32_t beats, uint64_t start,
+        std::vector<int64_t>* tracked=nullptr, std::vector<int64_t>* raw=nullptr) {
+    uint64_t period = 60000000ULL / (bpm * CLOCK_PPQN);
+    uint32_t seed = 1;
+    uint64_t lastArrival = 0;
+    int32_t first = pll.position() + 1;
+    for (uint32_t n = 0; n < beats * CLOCK_PPQN; ++n) {
+        uint64_t ideal = start + n * period;
+        seed = seed * 1103515245 + 12345;
+        uint64_t sent = ideal + (jitter ? (seed >> 8) % (jitter * 1000) : 0);
+        uint64_t arrival = interval ? (sent / (interval * 1000) + 1) * interval * 1000 : sent;
+        if (arrival < lastArrival)
+            arrival = lastArrival;
+        lastArrival = arrival;
+        if (tracked && n % CLOCK_PPQN == 0 && n >= SETTLE_BEATS * CLOCK_PPQN) {
+            tracked->push_back((int64_t)(int32_t)(pll.tickTime(first + n) - (uint32_t)ideal));
+            raw->push_back(arrival - ideal);
+        }
+        pll.tick(arrival);
+    }
+    return lastArrival;
+}
+
+// Check tracked beat jitter is within bounds and much less than clock arrival jitter
+static void checkTracking(uint32_t bpm, uint32_t interval, uint32_t jitterMs, double rmsLimit, double maxLimit) {
+    ClockPll pll;
+    pll.start();
+    std::vector<int64_t> tracked, raw;
+    uint64_t last = sendClocks(pll, bpm, interval, jitterMs, 200, 1000000, &tracked, &raw);
+    beat_error_t t = jitter(tracked);
+    beat_error_t r = jitter(raw);
+    printf("  %u bpm, interval %ums, jitter %ums: tracked rms %.0fus max %.0fus, raw rms %.0fus max %.0fus\n", bpm, interval, jitterMs, t.rms, t.max, r.rms, r.max);
+    TEST_ASSERT_TRUE(pll.locked(last));
+    TEST_ASSERT_UINT32_WITHIN(bpm * 10 / 200, bpm * 10, pll.bpm()); // Within 0.5%
+    TEST_ASSERT_TRUE(t.rms < rmsLimit);
+    TEST_ASSERT_TRUE(t.max < maxLimit);
+    if (interval || jitterMs)
+        TEST_ASSERT_TRUE(t.rms * 3 < r.rms);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_steady_clock() {
+    checkTracking(120, 0, 0, 50, 100);
+}
+
+void test_connection_interval() {
+    checkTracking(120, 15, 0, 1000, 2000);
+}
+
+void test_jittered_clock() {
+    checkTracking(120, 15, 10, 1500, 4000);
+    checkTracking(180, 7, 5, 1000, 3000);
+}
+
+// Long connection interval delivers clocks in bursts of two or more
+void test_bursty_clock() {
+    checkTracking(120, 45, 10, 2500, 6000);
+    checkTracking(240, 45, 0, 2000, 6000);
+    checkTracking(60, 30, 20, 3000, 8000);
+}
+
+void test_lock() {
+    ClockPll pll;
+    pll.start();
+    TEST_ASSERT_FALSE(pll.locked(0));
+    uint32_t us = 1000000;
+    for (uint8_t n = 0; n < CLOCK_ACQUIRE_TICKS; ++n, us += 25000) {
+        TEST_ASSERT_FALSE(pll.locked(us)); // Still estimating tempo
+        pll.tick(us);
+    }
+    TEST_ASSERT_TRUE(pll.locked(us - 25000));
+    TEST_ASSERT_UINT32_WITHIN(1, 1000, pll.bpm());
+    TEST_ASSERT_EQUAL_INT32(CLOCK_ACQUIRE_TICKS - 1, pll.position());
+}
+
+// Lock is lost when clocks stop arriving, e.g. sender stopped or disconnected
+void test_lock_lost_when_clock_stops() {
+    ClockPll pll;
+    pll.start();
+    uint64_t last = sendClocks(pll, 120, 15, 0, 4, 1000000);
+    TEST_ASSERT_TRUE(pll.locked(last));
+    TEST_ASSERT_TRUE(pll.locked(last + CLOCK_TIMEOUT_US - 1));
+    TEST_ASSERT_FALSE(pll.locked(last + CLOCK_TIMEOUT_US));
+    TEST_ASSERT_FALSE(pll.locked(last + 10 * CLOCK_TIMEOUT_US));
+
+    // MIDI Stop keeps tempo whilst clocks continue but position holds
+    pll.stop();
+    TEST_ASSERT_FALSE(pll.running());
+    int32_t position = pll.position();
+    last = sendClocks(pll, 120, 15, 0, 2, last + 20000);
+    TEST_ASSERT_EQUAL_INT32(position, pll.position());
+}
+
+// Clock resumes after a gap at a new tempo
+void test_relock_after_gap() {
+    ClockPll pll;
+    pll.start();
+    uint64_t last = sendClocks(pll, 120, 15, 0, 4, 1000000);
+    TEST_ASSERT_TRUE(pll.locked(last));
+    pll.start();
+    uint64_t resume = last + 2 * CLOCK_TIMEOUT_US;
+    pll.tick(resume);
+    TEST_ASSERT_FALSE(pll.locked(resume)); // Tempo not yet known
+    std::vector<int64_t> tracked, raw;
+    last = sendClocks(pll, 90, 15, 5, 40, resume + 60000000 / (90 * CLOCK_PPQN), &tracked, &raw);
+    TEST_ASSERT_TRUE(pll.locked(last));
+    TEST_ASSERT_UINT32_WITHIN(5, 900, pll.bpm());
+    TEST_ASSERT_TRUE(jitter(tracked).max < 4000);
+}
+
+// Tempo jump without a gap restarts tracking and locks to the new tempo
+void test_relock_after_tempo_jump() {
+    ClockPll pll;
+    pll.start();
+    uint64_t last = sendClocks(pll, 120, 0, 0, 4, 1000000);
+    bool lost = false;
+    for (uint8_t n = 1; n <= CLOCK_SLIP_TICKS * 2; ++n) {
+        pll.tick(last + n * 41666);
+        lost |= !pll.locked(last + n * 41666);
+    }
+    TEST_ASSERT_TRUE(lost);
+    last = sendClocks(pll, 60, 0, 0, 4, last + (CLOCK_SLIP_TICKS * 2 + 1) * 41666);
+    TEST_ASSERT_TRUE(pll.locked(last));
+    TEST_ASSERT_UINT32_WITHIN(3, 600, pll.bpm());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_steady_clock);
+    RUN_TEST(test_connection_interval);
+    RUN_TEST(test_jittered_clock);
+    RUN_TEST(test_bursty_clock);
+    RUN_TEST(test_lock);
+    RUN_TEST(test_lock_lost_when_clock_stops);
+    RUN_TEST(test_relock_after_gap);
+    RUN_TEST(test_relock_after_tempo_jump);
+    return UNITY_END();
+}
@@ -0,0 +1,147 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*  Host unit tests of tilt controller filtering: OneEuroFilter and ChangeThreshold
+    Filters are configured as the tilt controller: 100Hz, 1Hz cutoff when still, rising 1Hz per g/s (1g = 1024).
+    Run with: pio test -e native -f test_motion
+*/
+
+#include <unity.h>
+#include "motion.h"
+
+#define RATE 100
+#define MIN_CUTOFF 256
+#define BETA 66
+
+void setUp() {}
+void tearDown() {}
+
+void test_first_sample_unfiltered() {
+    OneEuroFilter filter;
+    filter.begin(RATE, MIN_CUTOFF, BETA);
+    TEST_ASSERT_EQUAL_INT32(500, filter.update(500));
+    TEST_ASSERT_EQUAL_INT32(500, filter.value());
+    filter.update(600);
+    filter.reset();
+    TEST_ASSERT_EQUAL_INT32(-300, filter.update(-300));
+}
+
+// Step from rest rises quickly without overshoot and settles on the new value
+void test_step_response() {
+    OneEuroFilter filter;
+    filter.begin(RATE, MIN_CUTOFF, BETA);
+    for (uint8_t i = 0; i < RATE; ++i)
+        TEST_ASSERT_EQUAL_INT32(0, filter.update(0));
+    int32_t last = 0;
+    for (uint16_t i = 1; i <= RATE; ++i) {
+        int32_t y = filter.update(1000);
+        TEST_ASSERT_TRUE(y >= last); // Monotonic
+        TEST_ASSERT_TRUE(y <= 1000); // No overshoot
+        if (i == 2)
+            TEST_ASSERT_TRUE(y >= 500); // Half way within 20ms
+        if (i == 20)
+            TEST_ASSERT_TRUE(y >= 990); // Within 1% within 200ms
+        last = y;
+    }
+    TEST_ASSERT_INT32_WITHIN(1, 1000, last);
+}
+
+// Sensor noise whilst still is smoothed to a small fraction of its amplitude
+void test_jitter_rejection_at_rest() {
+    OneEuroFilter filter;
+    filter.begin(RATE, MIN_CUTOFF, BETA);
+    uint32_t seed = 1;
+    int32_t inMin = INT32_MAX, inMax = INT32_MIN, outMin = INT32_MAX, outMax = INT32_MIN;
+    for (uint16_t i = 0; i < 3 * RATE; ++i) {
+        seed = seed * 1103515245 + 12345;
+        int32_t x = 500 + (int32_t)((seed >> 16) % 17) - 8; // +/-8
+        int32_t y = filter.update(x);
+        if (i < RATE)
+            continue; // Settling
+        if (x < inMin) inMin = x;
+        if (x > inMax) inMax = x;
+        if (y < outMin) outMin = y;
+        if (y > outMax) outMax = y;
+    }
+    TEST_ASSERT_TRUE(inMax - inMin >= 14);
+    TEST_ASSERT_TRUE(outMax - outMin <= 4);
+    TEST_ASSERT_INT32_WITHIN(3, 500, outMin);
+    TEST_ASSERT_INT32_WITHIN(3, 500, outMax);
+}
+
+// Fast movement raises cutoff so lag is much less than a fixed 1Hz low pass filter
+void test_lag_at_speed() {
+    OneEuroFilter adaptive, fixed;
+    adaptive.begin(RATE, MIN_CUTOFF, BETA);
+    fixed.begin(RATE, MIN_CUTOFF, 0);
+    int32_t x = 0, adaptiveLag = 0, fixedLag = 0;
+    for (uint8_t i = 0; i <= RATE / 2; ++i) {
+        x = i * 20; // 2000 units/s, about 2g/s
+        adaptiveLag = x - adaptive.update(x);
+        fixedLag = x - fixed.update(x);
+    }
+    TEST_ASSERT_TRUE(adaptiveLag > 0);
+    TEST_ASSERT_TRUE(adaptiveLag < 150);
+    TEST_ASSERT_TRUE(fixedLag > 2 * adaptiveLag);
+}
+
+void test_threshold_first_and_small_changes() {
+    ChangeThreshold threshold;
+    TEST_ASSERT_TRUE(threshold.update(64, 2));
+    TEST_ASSERT_EQUAL_UINT8(64, threshold.value());
+    TEST_ASSERT_FALSE(threshold.update(64, 2));
+    TEST_ASSERT_FALSE(threshold.update(65, 2));
+    TEST_ASSERT_FALSE(threshold.update(63, 2));
+    TEST_ASSERT_EQUAL_UINT8(64, threshold.value());
+    TEST_ASSERT_TRUE(threshold.update(66, 2));
+    TEST_ASSERT_TRUE(threshold.update(64, 2));
+    TEST_ASSERT_EQUAL_UINT8(64, threshold.value());
+}
+
+// Extremes are passed even when closer than threshold so full range can be reached
+void test_threshold_extremes() {
+    ChangeThreshold threshold;
+    TEST_ASSERT_TRUE(threshold.update(3, 4));
+    TEST_ASSERT_FALSE(threshold.update(1, 4));
+    TEST_ASSERT_TRUE(threshold.update(0, 4));
+    TEST_ASSERT_FALSE(threshold.update(0, 4)); // Unchanged
+    TEST_ASSERT_FALSE(threshold.update(2, 4));
+    TEST_ASSERT_EQUAL_UINT8(0, threshold.value());
+
+    TEST_ASSERT_TRUE(threshold.update(124, 4));
+    TEST_ASSERT_FALSE(threshold.update(126, 4));
+    TEST_ASSERT_TRUE(threshold.update(127, 4));
+    TEST_ASSERT_FALSE(threshold.update(127, 4)); // Unchanged
+    TEST_ASSERT_FALSE(threshold.update(125, 4));
+    TEST_ASSERT_EQUAL_UINT8(127, threshold.value());
+
+    // Custom range maximum
+    TEST_ASSERT_TRUE(threshold.update(98, 4, 100));
+    TEST_ASSERT_TRUE(threshold.update(100, 4, 100));
+    TEST_ASSERT_FALSE(threshold.update(99, 4, 100));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_first_sample_unfiltered);
+    RUN_TEST(test_step_response);
+    RUN_TEST(test_jitter_rejection_at_rest);
+    RUN_TEST(test_lag_at_speed);
+    RUN_TEST(test_threshold_first_and_small_changes);
+    RUN_TEST(test_threshold_extremes);
+    return UNITY_END();
+}
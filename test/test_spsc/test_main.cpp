@@ -0,0 +1,143 @@
+/*  riband - BLE MIDI wearable writsband
+Copyright (C) 2023-2024  riban ltd <info@riban.co.uk>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*  Host unit tests of SpscQueue
+    Run with: pio test -e native -f test_spsc
+*/
+
+#include <unity.h>
+#include <atomic>
+#include <thread>
+#include "spsc.h"
+
+#define STRESS_ITEMS 1000000 // Quantity of items passed between threads by each stress test
+
+// Item with a check value so that an item copied whilst being written is detected
+struct stress_item_t {
+    uint32_t seq;
+    uint32_t check; // ~seq
+    uint8_t pad[24]; // Makes item larger than one word so copies are not atomic
+};
+
+void setUp() {}
+void tearDown() {}
+
+void test_fifo_order() {
+    SpscQueue<uint32_t, 4> queue;
+    uint32_t item;
+    TEST_ASSERT_TRUE(queue.empty());
+    TEST_ASSERT_FALSE(queue.pop(item));
+    for (uint32_t i = 0; i < 4; ++i)
+        TEST_ASSERT_TRUE(queue.push(i));
+    TEST_ASSERT_TRUE(queue.peek(item));
+    TEST_ASSERT_EQUAL_UINT32(0, item);
+    for (uint32_t i = 0; i < 4; ++i) {
+        TEST_ASSERT_TRUE(queue.pop(item));
+        TEST_ASSERT_EQUAL_UINT32(i, item);
+    }
+    TEST_ASSERT_TRUE(queue.empty());
+}
+
+void test_overflow_counted() {
+    SpscQueue<uint32_t, 4> queue;
+    for (uint32_t i = 0; i < 6; ++i)
+        queue.push(i);
+    TEST_ASSERT_EQUAL_UINT32(2, queue.overflows());
+    TEST_ASSERT_EQUAL_UINT32(4, queue.highWater());
+    uint32_t items[8];
+    TEST_ASSERT_EQUAL_UINT32(4, queue.pop(items, 8));
+    for (uint32_t i = 0; i < 4; ++i)
+        TEST_ASSERT_EQUAL_UINT32(i, items[i]); // Rejected items do not replace queued items
+}
+
+// Indices wrap past 2^32 without losing items
+void test_index_wrap() {
+    SpscQueue<uint32_t, 8> queue;
+    uint32_t item;
+    for (uint32_t i = 0; i < 100000; ++i) {
+        TEST_ASSERT_TRUE(queue.push(i));
+        TEST_ASSERT_TRUE(queue.push(~i));
+        TEST_ASSERT_TRUE(queue.pop(item));
+        TEST_ASSERT_EQUAL_UINT32(i, item);
+        TEST_ASSERT_TRUE(queue.pop(item));
+        TEST_ASSERT_EQUAL_UINT32(~i, item);
+    }
+}
+
+/*  Producer thread pushes a sequence whilst consumer thread pops it
+    batch: Most items consumer pops at once (1 uses single item pop)
+    Each item must arrive once, in order and intact. Producer retries when full so every rejected push is an overflow.
+*/
+static void stress(uint32_t batch) {
+    SpscQueue<stress_item_t, 64> queue;
+    std::atomic<uint32_t> rejected{0};
+    std::atomic<bool> done{false}; // Set by producer when all items are pushed
+    std::atomic<bool> stop{false}; // Set by consumer if it gives up
+    std::thread producer([&queue, &rejected, &done, &stop]() {
+        uint32_t rejects = 0;
+        for (uint32_t seq = 0; seq < STRESS_ITEMS && !stop; ++seq) {
+            stress_item_t item = {seq, ~seq, {}};
+            while (!queue.push(item) && !stop) {
+                ++rejects;
+                std::this_thread::yield(); // Let consumer run if both threads share a core
+            }
+        }
+        rejected = rejects;
+        done = true;
+    });
+    uint32_t expected = 0; // Sequence number of next item
+    uint32_t received = 0;
+    uint32_t errors = 0;
+    stress_item_t items[16];
+    // Stop once producer has finished and queue is drained, or if more items arrive than were sent
+    while ((!done || !queue.empty()) && received <= STRESS_ITEMS) {
+        uint32_t count = batch > 1 ? queue.pop(items, batch) : queue.pop(items[0]);
+        if (!count)
+            std::this_thread::yield();
+        for (uint32_t i = 0; i < count; ++i) {
+            if (items[i].seq != expected || items[i].check != ~expected)
+                ++errors; // Lost, duplicated, reordered or torn item
+            expected = items[i].seq + 1;
+        }
+        received += count;
+    }
+    stop = true;
+    producer.join();
+    TEST_ASSERT_EQUAL_UINT32(0, errors);
+    TEST_ASSERT_EQUAL_UINT32(STRESS_ITEMS, received);
+    TEST_ASSERT_TRUE(queue.empty());
+    TEST_ASSERT_EQUAL_UINT32(rejected.load(), queue.overflows());
+    TEST_ASSERT_LESS_OR_EQUAL(64, queue.highWater());
+}
+
+void test_threads_single_pop() {
+    stress(1);
+}
+
+void test_threads_batch_pop() {
+    stress(16);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_fifo_order);
+    RUN_TEST(test_overflow_counted);
+    RUN_TEST(test_index_wrap);
+    RUN_TEST(test_threads_single_pop);
+    RUN_TEST(test_threads_batch_pop);
+    return UNITY_END();
+}